@@ -0,0 +1,111 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --- Shared helpers for the host benchmarks ---
+//
+// Results are printed one metric per line, so runs can be diffed or parsed by
+// a script:
+//   <name> n=<samples> min=<> p50=<> p90=<> p99=<> max=<> unit=<unit>    distributions
+//   <name> ns_op=<> allocs=<> iters=<>                                    Bench_Run()
+//
+// With -DBENCH_COUNT_ALLOCS and -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// (the native env in platformio.ini) every heap call from the code under test
+// is counted. The firmware has no heap, so anything but allocs=0 is a regression.
+
+#define BENCH_SAMPLES_MAX (1u << 20)    // Samples kept per metric, later ones are counted only
+#define BENCH_REPEAT 5                  // Bench_Run() reports the fastest of this many runs
+
+volatile uint32_t bench_allocs;
+volatile uint32_t bench_sink;           // Results go here so the optimiser keeps the work
+
+#ifdef BENCH_COUNT_ALLOCS
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n) {
+    bench_allocs++;
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    bench_allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+    bench_allocs++;
+    return __real_realloc(p, n);
+}
+#endif
+
+typedef struct {
+    uint32_t *v;
+    uint32_t n;                 // Samples stored
+    uint64_t total;             // Samples seen
+} Samples;
+
+static inline uint64_t Bench_Ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static inline void Samples_Add(Samples *s, uint32_t x) {
+    s->total++;
+    if (s->n == BENCH_SAMPLES_MAX) return;
+    if (s->v == NULL) {
+        s->v = malloc(BENCH_SAMPLES_MAX * sizeof(uint32_t));
+        if (s->v == NULL) return;
+    }
+    s->v[s->n++] = x;
+}
+
+static int Bench_CmpU32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Print min/percentiles/max (sorts the samples in place)
+ */
+static inline void Samples_Print(const char *name, Samples *s, const char *unit) {
+    if (s->n == 0) {
+        printf("%s n=0 unit=%s\n", name, unit);
+        return;
+    }
+    qsort(s->v, s->n, sizeof(uint32_t), Bench_CmpU32);
+    printf("%s n=%llu min=%u p50=%u p90=%u p99=%u max=%u unit=%s\n", name,
+        (unsigned long long)s->total, s->v[0],
+        s->v[(s->n - 1) * 50 / 100], s->v[(s->n - 1) * 90 / 100],
+        s->v[(uint64_t)(s->n - 1) * 99 / 100], s->v[s->n - 1], unit);
+}
+
+/**
+ * Time fn(iters), fastest of BENCH_REPEAT runs, and print its line.
+ * Returns the heap calls of one run (0 expected).
+ */
+static inline uint32_t Bench_Run(const char *name, void (*fn)(uint32_t iters), uint32_t iters) {
+    uint64_t best = UINT64_MAX;
+    uint32_t allocs = 0;
+
+    fn(iters / 10 + 1);         // Warm up caches and branch predictors
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        uint32_t a0 = bench_allocs;
+        uint64_t t0 = Bench_Ns();
+        fn(iters);
+        uint64_t t = Bench_Ns() - t0;
+        if (t < best) best = t;
+        allocs = bench_allocs - a0;
+    }
+    printf("%s ns_op=%.2f allocs=%u iters=%u\n", name, (double)best / iters, allocs, iters);
+    return allocs;
+}
+
+#endif
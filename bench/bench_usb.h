@@ -0,0 +1,54 @@
+#ifndef BENCH_USB_H
+#define BENCH_USB_H
+
+#include "CH58x_common.h"
+#include "usb_device.h"
+
+// --- Application side of usb_device.h for single-device benchmarks ---
+//
+// One register block, EP0/EP1 buffers mapped as main.c does, vendor requests
+// STALLed. BenchUsb_Setup()/BenchUsb_Token() load a packet into the registers
+// the way the SIE would and run the interrupt handler once.
+
+UsbRegs bench_usb_regs = { .uep0_ctrl = UEP_R_RES_ACK | UEP_T_RES_NAK,
+                           .uep1_ctrl = UEP_R_RES_ACK | UEP_T_RES_NAK | RB_UEP_AUTO_TOG };
+UsbRegs *usb_regs = &bench_usb_regs;
+uint8_t *pEP0_RAM_Addr = EP0_Databuf;
+uint8_t *pEP1_RAM_Addr = EP1_Databuf;
+
+void GetUniqueID(uint8_t *buf) {
+    memset(buf, 0xA5, 8);
+}
+
+uint8_t USB_VendorSetup(void) {
+    return USB_VENDOR_STALL;
+}
+
+void USB_VendorOut(uint8_t len) {
+    (void)len;
+}
+
+/**
+ * SETUP packet on EP0, then the interrupt
+ */
+static inline void BenchUsb_Setup(uint8_t type, uint8_t req, uint16_t value, uint16_t index, uint16_t len) {
+    USB_SETUP_REQ r = { type, req, value, index, len };
+
+    memcpy(pEP0_RAM_Addr, &r, sizeof(r));
+    R8_USB_RX_LEN = sizeof(r);
+    R8_USB_INT_ST = UIS_TOKEN_SETUP | RB_UIS_SETUP_ACT;
+    R8_USB_INT_FG = RB_UIF_TRANSFER;
+    USB_DevTransProcess();
+}
+
+/**
+ * Completed IN/OUT transaction (UIS_TOKEN_x | endpoint), then the interrupt
+ */
+static inline void BenchUsb_Token(uint8_t token_ep, uint8_t rx_len) {
+    R8_USB_RX_LEN = rx_len;
+    R8_USB_INT_ST = token_ep | RB_UIS_TOG_OK;
+    R8_USB_INT_FG = RB_UIF_TRANSFER;
+    USB_DevTransProcess();
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef CH58X_COMMON_H
+#define CH58X_COMMON_H
+
+// --- Host stand-in for the WCH SDK header (benchmarks only) ---
+//
+// Just enough of CH58x_common.h to compile the firmware's hardware-free headers,
+// the USB device handler (usb_device.h) and the UART logger (debug.h) on a PC.
+// The USB registers live in a UsbRegs block selected through usb_regs, so a
+// benchmark can run several device instances by pointing it at a different
+// block. UART1 never fills up. Values of the bit definitions match the SDK.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define __INTERRUPT
+#define __HIGH_CODE
+
+#define ENABLE  1
+#define DISABLE 0
+
+// USB device registers of the instance being run
+typedef struct {
+    uint8_t usb_int_fg;
+    uint8_t usb_int_st;
+    uint8_t usb_mis_st;
+    uint8_t usb_dev_ad;
+    uint8_t usb_rx_len;
+    uint8_t uep0_ctrl;
+    uint8_t uep0_t_len;
+    uint8_t uep1_ctrl;
+    uint8_t uep1_t_len;
+} UsbRegs;
+
+extern UsbRegs *usb_regs;
+
+#define R8_USB_INT_FG  (usb_regs->usb_int_fg)
+#define R8_USB_INT_ST  (usb_regs->usb_int_st)
+#define R8_USB_MIS_ST  (usb_regs->usb_mis_st)
+#define R8_USB_DEV_AD  (usb_regs->usb_dev_ad)
+#define R8_USB_RX_LEN  (usb_regs->usb_rx_len)
+#define R8_UEP0_CTRL   (usb_regs->uep0_ctrl)
+#define R8_UEP0_T_LEN  (usb_regs->uep0_t_len)
+#define R8_UEP1_CTRL   (usb_regs->uep1_ctrl)
+#define R8_UEP1_T_LEN  (usb_regs->uep1_t_len)
+
+extern uint8_t *pEP0_RAM_Addr;
+extern uint8_t *pEP1_RAM_Addr;
+
+// R8_USB_INT_FG
+#define RB_UIF_BUS_RST      0x01
+#define RB_UIF_TRANSFER     0x02
+#define RB_UIF_SUSPEND      0x04
+
+// R8_USB_INT_ST
+#define MASK_UIS_ENDP       0x0F
+#define MASK_UIS_TOKEN      0x30
+#define UIS_TOKEN_OUT       0x00
+#define UIS_TOKEN_IN        0x20
+#define UIS_TOKEN_SETUP     0x30
+#define RB_UIS_TOG_OK       0x40
+#define RB_UIS_SETUP_ACT    0x80
+
+// R8_USB_MIS_ST, R8_USB_DEV_AD
+#define RB_UMS_SUSPEND      0x04
+#define RB_UDA_GP_BIT       0x80
+
+// R8_UEPn_CTRL
+#define MASK_UEP_T_RES      0x03
+#define UEP_T_RES_ACK       0x00
+#define UEP_T_RES_NAK       0x02
+#define UEP_T_RES_STALL     0x03
+#define MASK_UEP_R_RES      0x0C
+#define UEP_R_RES_ACK       0x00
+#define UEP_R_RES_NAK       0x08
+#define UEP_R_RES_STALL     0x0C
+#define RB_UEP_AUTO_TOG     0x10
+#define RB_UEP_T_TOG        0x40
+#define RB_UEP_R_TOG        0x80
+
+// USB standard definitions (CH58x_usbdev.h)
+#define USB_REQ_TYP_IN          0x80
+#define USB_REQ_TYP_MASK        0x60
+#define USB_REQ_TYP_STANDARD    0x00
+#define USB_REQ_TYP_CLASS       0x20
+#define USB_REQ_TYP_VENDOR      0x40
+#define USB_REQ_RECIP_MASK      0x1F
+#define USB_REQ_RECIP_DEVICE    0x00
+#define USB_REQ_RECIP_INTERF    0x01
+#define USB_REQ_RECIP_ENDP      0x02
+
+#define USB_GET_STATUS          0x00
+#define USB_CLEAR_FEATURE       0x01
+#define USB_SET_FEATURE         0x03
+#define USB_SET_ADDRESS         0x05
+#define USB_GET_DESCRIPTOR      0x06
+#define USB_SET_DESCRIPTOR      0x07
+#define USB_GET_CONFIGURATION   0x08
+#define USB_SET_CONFIGURATION   0x09
+#define USB_GET_INTERFACE       0x0A
+#define USB_SET_INTERFACE       0x0B
+#define USB_SYNCH_FRAME         0x0C
+
+#define USB_DESCR_TYP_DEVICE    0x01
+#define USB_DESCR_TYP_CONFIG    0x02
+#define USB_DESCR_TYP_STRING    0x03
+#define USB_DESCR_TYP_INTERF    0x04
+#define USB_DESCR_TYP_ENDP      0x05
+#define USB_DESCR_TYP_QUALIF    0x06
+#define USB_DESCR_TYP_SPEED     0x07
+#define USB_DESCR_TYP_HID       0x21
+#define USB_DESCR_TYP_REPORT    0x22
+
+typedef struct {
+    uint8_t  bRequestType;
+    uint8_t  bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} USB_SETUP_REQ;
+
+// UART1 (debug.h)
+typedef struct {
+    uint8_t tfc;                // TX FIFO count
+    uint8_t thr;                // Last byte written
+    uint8_t rfc;
+    uint8_t rbr;
+    uint8_t lsr;
+} UartRegs;
+
+extern UartRegs uart1_regs;
+
+#define R8_UART1_TFC (uart1_regs.tfc)
+#define R8_UART1_THR (uart1_regs.thr)
+#define R8_UART1_RFC (uart1_regs.rfc)
+#define R8_UART1_RBR (uart1_regs.rbr)
+#define R8_UART1_LSR (uart1_regs.lsr)
+
+#define UART_FIFO_SIZE      8
+#define RB_LSR_DATA_RDY     0x01
+#define RB_LSR_TX_ALL_EMP   0x40
+
+// GPIO pin bits (keyboard_def.h)
+#define GPIO_Pin_0  0x0001
+#define GPIO_Pin_1  0x0002
+#define GPIO_Pin_2  0x0004
+#define GPIO_Pin_3  0x0008
+#define GPIO_Pin_4  0x0010
+#define GPIO_Pin_5  0x0020
+#define GPIO_Pin_6  0x0040
+#define GPIO_Pin_7  0x0080
+#define GPIO_Pin_8  0x0100
+#define GPIO_Pin_9  0x0200
+#define GPIO_Pin_12 0x1000
+#define GPIO_Pin_13 0x2000
+#define GPIO_Pin_14 0x4000
+#define GPIO_Pin_15 0x8000
+
+typedef enum {
+    GPIO_ModeIN_Floating,
+    GPIO_ModeIN_PU,
+    GPIO_ModeIN_PD,
+    GPIO_ModeOut_PP_5mA,
+    GPIO_ModeOut_PP_20mA
+} GPIOModeTypeDef;
+
+static inline void GPIOA_SetBits(uint32_t pin) { (void)pin; }
+static inline void GPIOA_ModeCfg(uint32_t pin, GPIOModeTypeDef mode) { (void)pin; (void)mode; }
+static inline void UART1_DefInit(void) { uart1_regs.lsr = RB_LSR_TX_ALL_EMP; }
+
+void GetUniqueID(uint8_t *buf);
+
+#endif
@@ -0,0 +1,107 @@
+// --- USB control request handler benchmark (native env, see platformio.ini) ---
+//
+// Whole control transfers through USB_DevTransProcess(): every interrupt of the
+// SETUP, data and status stages. The enumeration trace is full after the warm-up
+// run, as on a device that has enumerated, so logging is not part of the figures
+// (test_log covers it).
+
+#include <unity.h>
+#include "bench.h"
+#include "bench_usb.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// IN request: SETUP, one data packet, status OUT
+static void Transfer_In(uint8_t type, uint8_t req, uint16_t value, uint16_t len) {
+    BenchUsb_Setup(type, req, value, 0, len);
+    BenchUsb_Token(UIS_TOKEN_IN | 0, 0);
+    BenchUsb_Token(UIS_TOKEN_OUT | 0, 0);
+}
+
+static void Bench_GetDevice(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) Transfer_In(0x80, USB_GET_DESCRIPTOR, 0x0100, 64);
+}
+
+static void Bench_GetConfig(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) Transfer_In(0x80, USB_GET_DESCRIPTOR, 0x0200, 255);
+}
+
+static void Bench_GetReportDescr(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) Transfer_In(0x81, USB_GET_DESCRIPTOR, 0x2200, 255);
+}
+
+static void Bench_GetString(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) Transfer_In(0x80, USB_GET_DESCRIPTOR, 0x0303, 255);
+}
+
+static void Bench_HidGetReport(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) Transfer_In(0xA1, HID_GET_REPORT, 0x0100, HID_REPORT_MAX);
+}
+
+static void Bench_SetAddress(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        BenchUsb_Setup(0x00, USB_SET_ADDRESS, 1 + (i & 0x3F), 0, 0);
+        BenchUsb_Token(UIS_TOKEN_IN | 0, 0);
+    }
+}
+
+static void Bench_Stall(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) BenchUsb_Setup(0x80, USB_SYNCH_FRAME, 0, 0, 2);
+}
+
+static void Bench_Ep1In(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) BenchUsb_Token(UIS_TOKEN_IN | 1, 0);
+}
+
+void test_get_device_descriptor(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.get_device_descriptor", Bench_GetDevice, 1000000));
+    BenchUsb_Setup(0x80, USB_GET_DESCRIPTOR, 0x0100, 0, 64);
+    TEST_ASSERT_EQUAL_UINT8(sizeof(MyDevDescr), R8_UEP0_T_LEN);
+    TEST_ASSERT_EQUAL_MEMORY(MyDevDescr, EP0_Databuf, sizeof(MyDevDescr));
+}
+
+void test_get_config_descriptor(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.get_config_descriptor", Bench_GetConfig, 1000000));
+}
+
+void test_get_report_descriptor(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.get_report_descriptor", Bench_GetReportDescr, 1000000));
+}
+
+void test_get_string(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.get_string", Bench_GetString, 1000000));
+}
+
+void test_hid_get_report(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.hid_get_report", Bench_HidGetReport, 1000000));
+}
+
+void test_set_address(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.set_address", Bench_SetAddress, 1000000));
+    TEST_ASSERT_EQUAL(USB_STATE_ADDRESSED, UsbState);
+}
+
+void test_stall(void) {
+    uint32_t stalls = UsbStallCount;
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.stall", Bench_Stall, 1000000));
+    TEST_ASSERT_TRUE(UsbStallCount > stalls);
+}
+
+void test_ep1_in(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("control.ep1_in", Bench_Ep1In, 1000000));
+}
+
+int main(void) {
+    USB_InitSerial();
+    UNITY_BEGIN();
+    RUN_TEST(test_get_device_descriptor);
+    RUN_TEST(test_get_config_descriptor);
+    RUN_TEST(test_get_report_descriptor);
+    RUN_TEST(test_get_string);
+    RUN_TEST(test_hid_get_report);
+    RUN_TEST(test_set_address);
+    RUN_TEST(test_stall);
+    RUN_TEST(test_ep1_in);
+    return UNITY_END();
+}
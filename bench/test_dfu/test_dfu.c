@@ -0,0 +1,316 @@
+// --- Firmware update state machine tests (native env, see platformio.ini) ---
+//
+// dfu.h against a RAM model of the staging slot. The model behaves like
+// CodeFlash: erase works on whole sectors and sets them to 0xFF, and program
+// fails on any byte that is not erased, so programming ahead of the erase
+// pointer shows up as a flash error. The host side runs the request sequence the
+// way USB_VendorOut() does, and the main loop's Dfu_Process() is interleaved
+// with it (one call per packet, more while both page buffers are full).
+
+#include <unity.h>
+#include "bench.h"
+#include "dfu.h"
+
+static uint8_t flash[DFU_SLOT_SIZE];
+static uint8_t image[3 * DFU_SECTOR_SIZE + 100];    // Ends on a 36-byte packet
+
+// Flash model bookkeeping
+static DfuImageInfo pending;
+static uint32_t n_pending, n_erase, n_program, erase_before_first_program;
+static uint32_t max_erase_ahead;        // Largest erased-but-unprogrammed span seen
+static uint32_t programmed_end;
+static uint8_t fail_program;
+
+static int Fake_Erase(uint32_t addr, uint32_t len) {
+    addr -= DFU_SLOT_ADDR;
+    if (addr % DFU_SECTOR_SIZE || len != DFU_SECTOR_SIZE || addr + len > DFU_SLOT_SIZE) return -1;
+    memset(flash + addr, 0xFF, len);
+    n_erase++;
+    if (addr + len - programmed_end > max_erase_ahead) max_erase_ahead = addr + len - programmed_end;
+    return 0;
+}
+
+static int Fake_Program(uint32_t addr, const uint8_t *buf, uint32_t len) {
+    addr -= DFU_SLOT_ADDR;
+    if (fail_program || addr % 4 || len % 4 || addr + len > DFU_SLOT_SIZE) return -1;
+    for (uint32_t i = 0; i < len; i++) {
+        if (flash[addr + i] != 0xFF) return -1;     // Not erased
+    }
+    memcpy(flash + addr, buf, len);
+    if (n_program++ == 0) erase_before_first_program = n_erase;
+    if (addr + len > programmed_end) programmed_end = addr + len;
+    return 0;
+}
+
+static int Fake_Read(uint32_t addr, uint8_t *buf, uint32_t len) {
+    addr -= DFU_SLOT_ADDR;
+    if (addr + len > DFU_SLOT_SIZE) return -1;
+    memcpy(buf, flash + addr, len);
+    return 0;
+}
+
+static int Fake_SetPending(const DfuImageInfo *info) {
+    pending = *info;
+    n_pending++;
+    return 0;
+}
+
+static const DfuFlashOps fake_ops = { Fake_Erase, Fake_Program, Fake_Read, Fake_SetPending };
+
+static DfuCtx dfu;
+
+static uint32_t Image_Crc(uint32_t len) {
+    return Dfu_Crc32(0xFFFFFFFF, image, len) ^ 0xFFFFFFFF;
+}
+
+/**
+ * Start request as the ISR posts it, then the main loop takes it over
+ */
+static DfuStatus Host_Start(uint32_t size, uint32_t crc) {
+    DfuStatus st = Dfu_PostStart(&dfu, size, crc);
+    if (st == DFU_OK) {
+        TEST_ASSERT_TRUE(Dfu_PostPending(&dfu));
+        TEST_ASSERT_EQUAL_UINT8(DFU_BUSY, Dfu_Write(&dfu, 0, image, DFU_PKT_SIZE));
+        TEST_ASSERT_EQUAL_UINT8(1, Dfu_Process(&dfu));
+        TEST_ASSERT_TRUE(!Dfu_PostPending(&dfu));
+    }
+    return st;
+}
+
+/**
+ * Send packet seq of the image, running the main loop while the ISR would hold
+ * the status stage. Returns what the last Dfu_Write() said.
+ */
+static DfuStatus Host_Data(uint16_t seq, uint16_t len) {
+    DfuStatus st;
+    int spins = 0;
+
+    while ((st = Dfu_Write(&dfu, seq, image + (uint32_t)seq * DFU_PKT_SIZE, len)) == DFU_BUSY && spins++ < 100) {
+        Dfu_Process(&dfu);
+    }
+    Dfu_Process(&dfu);
+    return st;
+}
+
+/**
+ * Whole image, packet by packet. Returns the first error, DFU_OK if all were taken.
+ */
+static DfuStatus Host_Image(uint32_t size) {
+    for (uint32_t off = 0, seq = 0; off < size; off += DFU_PKT_SIZE, seq++) {
+        uint16_t len = (size - off < DFU_PKT_SIZE) ? size - off : DFU_PKT_SIZE;
+        DfuStatus st = Host_Data(seq, len);
+        if (st != DFU_OK) return st;
+    }
+    return DFU_OK;
+}
+
+static void Main_Finish(void) {
+    for (int i = 0; i < 1000 && Dfu_Active(&dfu); i++) Dfu_Process(&dfu);
+}
+
+void setUp(void) {
+    memset(flash, 0x00, sizeof(flash));     // Programmed garbage: nothing is writable before an erase
+    memset(&pending, 0, sizeof(pending));
+    n_pending = n_erase = n_program = erase_before_first_program = 0;
+    max_erase_ahead = programmed_end = 0;
+    fail_program = 0;
+    Dfu_Init(&dfu, &fake_ops);
+}
+
+void tearDown(void) {}
+
+void test_full_image_is_staged(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Image(sizeof(image)));
+    Main_Finish();
+
+    TEST_ASSERT_EQUAL_UINT8(DFU_READY, dfu.state);
+    TEST_ASSERT_EQUAL_MEMORY(image, flash, sizeof(image));
+    // Tail of the last page is padded with erased bytes
+    TEST_ASSERT_EQUAL_UINT8(0xFF, flash[sizeof(image)]);
+    TEST_ASSERT_EQUAL_UINT32(1, n_pending);
+    TEST_ASSERT_EQUAL_UINT32(DFU_MAGIC, pending.magic);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(image), pending.size);
+    TEST_ASSERT_EQUAL_UINT32(Image_Crc(sizeof(image)), pending.crc);
+}
+
+void test_erase_runs_ahead_of_program(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Image(sizeof(image)));
+    Main_Finish();
+
+    // Every sector erased exactly once, and not all of them before the first program:
+    // erase and program are interleaved, at most two sectors ahead
+    TEST_ASSERT_EQUAL_UINT32((sizeof(image) + DFU_SECTOR_SIZE - 1) / DFU_SECTOR_SIZE, n_erase);
+    TEST_ASSERT_TRUE(erase_before_first_program >= 1);
+    TEST_ASSERT_TRUE(erase_before_first_program < n_erase);
+    TEST_ASSERT_TRUE(max_erase_ahead <= 2 * DFU_SECTOR_SIZE);
+    TEST_ASSERT_EQUAL_UINT32((sizeof(image) + DFU_PAGE_SIZE - 1) / DFU_PAGE_SIZE, n_program);
+}
+
+void test_program_waits_for_erase(void) {
+    // Both page buffers fill before the main loop gets to run at all
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    for (uint16_t seq = 0; seq < 2 * DFU_PAGE_SIZE / DFU_PKT_SIZE; seq++) {
+        TEST_ASSERT_EQUAL_UINT8(DFU_OK, Dfu_Write(&dfu, seq, image + seq * DFU_PKT_SIZE, DFU_PKT_SIZE));
+    }
+    TEST_ASSERT_TRUE(!Dfu_CanAccept(&dfu));
+    TEST_ASSERT_EQUAL_UINT8(DFU_BUSY, Dfu_Write(&dfu, 8, image + 8 * DFU_PKT_SIZE, DFU_PKT_SIZE));
+
+    // The sector is erased before the first page goes in, then a buffer frees up
+    TEST_ASSERT_EQUAL_UINT8(0, Dfu_Process(&dfu));
+    TEST_ASSERT_EQUAL_UINT32(1, n_erase);
+    TEST_ASSERT_EQUAL_UINT32(0, n_program);
+    TEST_ASSERT_EQUAL_UINT8(1, Dfu_Process(&dfu));
+    TEST_ASSERT_EQUAL_UINT32(1, n_program);
+    TEST_ASSERT_TRUE(Dfu_CanAccept(&dfu));
+
+    for (uint32_t off = 8 * DFU_PKT_SIZE, seq = 8; off < sizeof(image); off += DFU_PKT_SIZE, seq++) {
+        uint16_t len = (sizeof(image) - off < DFU_PKT_SIZE) ? sizeof(image) - off : DFU_PKT_SIZE;
+        TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Data(seq, len));
+    }
+    Main_Finish();
+    TEST_ASSERT_EQUAL_UINT8(DFU_READY, dfu.state);
+    TEST_ASSERT_EQUAL_MEMORY(image, flash, sizeof(image));
+}
+
+void test_short_last_packet(void) {
+    // 36-byte last packet accepted, the one before it must still be full
+    uint32_t size = 2 * DFU_PKT_SIZE + 36;
+
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(size, Image_Crc(size)));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Image(size));
+    Main_Finish();
+    TEST_ASSERT_EQUAL_UINT8(DFU_READY, dfu.state);
+    TEST_ASSERT_EQUAL_MEMORY(image, flash, size);
+}
+
+void test_short_packet_mid_image(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Data(0, DFU_PKT_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SIZE, Host_Data(1, 32));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERROR, dfu.state);
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SIZE, dfu.error);
+}
+
+void test_packet_past_the_end(void) {
+    uint32_t size = DFU_PKT_SIZE + 10;
+
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(size, Image_Crc(size)));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Data(0, DFU_PKT_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SIZE, Host_Data(1, DFU_PKT_SIZE));
+}
+
+void test_sequence_gap(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Data(0, DFU_PKT_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SEQ, Host_Data(2, DFU_PKT_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERROR, dfu.state);
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SEQ, dfu.error);
+    // Nothing more is accepted until a new START
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_STATE, Host_Data(1, DFU_PKT_SIZE));
+}
+
+void test_sequence_repeat(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Data(0, DFU_PKT_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SEQ, Host_Data(0, DFU_PKT_SIZE));
+}
+
+void test_data_before_start(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_STATE, Host_Data(0, DFU_PKT_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(DFU_IDLE, dfu.state);
+}
+
+void test_start_size_checked_in_isr(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SIZE, Dfu_PostStart(&dfu, 0, 0));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_SIZE, Dfu_PostStart(&dfu, DFU_SLOT_SIZE + 1, 0));
+    TEST_ASSERT_TRUE(!Dfu_PostPending(&dfu));
+}
+
+void test_crc_mismatch(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image)) ^ 1));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Image(sizeof(image)));
+    Main_Finish();
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERROR, dfu.state);
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_CRC, dfu.error);
+    TEST_ASSERT_EQUAL_UINT32(0, n_pending);
+}
+
+void test_program_failure(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    fail_program = 1;
+    Host_Image(sizeof(image));
+    Main_Finish();
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERROR, dfu.state);
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_FLASH, dfu.error);
+    TEST_ASSERT_EQUAL_UINT32(0, n_pending);
+}
+
+void test_restart_while_main_loop_busy(void) {
+    // First transfer stops halfway with a page waiting for the main loop
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), 0));
+    for (uint16_t seq = 0; seq < DFU_PAGE_SIZE / DFU_PKT_SIZE; seq++) {
+        TEST_ASSERT_EQUAL_UINT8(DFU_OK, Dfu_Write(&dfu, seq, image + seq * DFU_PKT_SIZE, DFU_PKT_SIZE));
+    }
+    TEST_ASSERT_TRUE(dfu.full[0]);
+
+    // START again from the ISR: the main loop still owns the old context until it
+    // takes the post, the ISR side refuses data meanwhile
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Dfu_PostStart(&dfu, sizeof(image), Image_Crc(sizeof(image))));
+    TEST_ASSERT_TRUE(Dfu_Active(&dfu));
+    TEST_ASSERT_EQUAL_UINT8(DFU_BUSY, Dfu_Write(&dfu, 4, image, DFU_PKT_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(1, Dfu_Process(&dfu));
+    TEST_ASSERT_EQUAL_UINT8(DFU_RECEIVING, dfu.state);
+    TEST_ASSERT_EQUAL_UINT32(0, dfu.received);
+    TEST_ASSERT_EQUAL_UINT32(0, dfu.programmed);
+    TEST_ASSERT_EQUAL_UINT32(0, dfu.erased);
+    TEST_ASSERT_TRUE(!dfu.full[0] && !dfu.full[1]);
+
+    // The new transfer re-erases before it programs and completes
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Image(sizeof(image)));
+    Main_Finish();
+    TEST_ASSERT_EQUAL_UINT8(DFU_READY, dfu.state);
+    TEST_ASSERT_EQUAL_MEMORY(image, flash, sizeof(image));
+}
+
+void test_abort(void) {
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Start(sizeof(image), Image_Crc(sizeof(image))));
+    TEST_ASSERT_EQUAL_UINT8(DFU_OK, Host_Data(0, DFU_PKT_SIZE));
+    Dfu_PostAbort(&dfu);
+    TEST_ASSERT_EQUAL_UINT8(DFU_RECEIVING, dfu.state);     // Untouched until the main loop runs
+    Dfu_Process(&dfu);
+    TEST_ASSERT_EQUAL_UINT8(DFU_IDLE, dfu.state);
+    TEST_ASSERT_TRUE(!Dfu_Active(&dfu));
+    TEST_ASSERT_EQUAL_UINT8(DFU_ERR_STATE, Host_Data(1, DFU_PKT_SIZE));
+}
+
+void test_no_heap(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, bench_allocs);
+}
+
+int main(void) {
+    uint32_t x = 0x12345678;
+    for (uint32_t i = 0; i < sizeof(image); i++) {
+        x = x * 1103515245 + 12345;
+        image[i] = x >> 24;
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_full_image_is_staged);
+    RUN_TEST(test_erase_runs_ahead_of_program);
+    RUN_TEST(test_program_waits_for_erase);
+    RUN_TEST(test_short_last_packet);
+    RUN_TEST(test_short_packet_mid_image);
+    RUN_TEST(test_packet_past_the_end);
+    RUN_TEST(test_sequence_gap);
+    RUN_TEST(test_sequence_repeat);
+    RUN_TEST(test_data_before_start);
+    RUN_TEST(test_start_size_checked_in_isr);
+    RUN_TEST(test_crc_mismatch);
+    RUN_TEST(test_program_failure);
+    RUN_TEST(test_restart_while_main_loop_busy);
+    RUN_TEST(test_abort);
+    RUN_TEST(test_no_heap);
+    return UNITY_END();
+}
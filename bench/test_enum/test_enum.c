@@ -0,0 +1,308 @@
+// --- Enumeration replay tests (native env, see platformio.ini) ---
+//
+// Replays the control request sequences Windows, Linux and macOS send to a
+// full-speed HID keyboard through USB_DevTransProcess(), on the bench_usb.h
+// register block. The host side behaves like the SIE and the host controller:
+// before every data or status packet it looks at the endpoint's response bits
+// and data toggle, an OUT packet whose toggle does not match R_TOG arrives
+// without RB_UIS_TOG_OK, and a multi-packet IN stage ends on a short packet or
+// once wLength bytes are in.
+//
+// The scripts follow the request order each host's enumeration uses for a boot
+// keyboard (Windows 10 usbhub3, Linux hub.c/usbhid, macOS IOUSBHostFamily);
+// they are written down from that order, not captured from this board. Every
+// STALL a host would retry must be absent; the only STALL is the Microsoft OS
+// string descriptor probe, which Windows expects to fail on devices without one.
+
+#include <unity.h>
+#include "bench.h"
+#include "bench_usb.h"
+
+typedef enum {
+    XFER_OK = 0,
+    XFER_STALL,         // Device STALLed a stage, the host retries the request
+    XFER_NAK,           // Stage never completes (host times out)
+    XFER_TOGGLE,        // Data toggle out of sequence
+    XFER_LENGTH         // Wrong amount of data
+} XferResult;
+
+typedef struct {
+    uint8_t  type;      // bmRequestType, HOST_RESET for a bus reset
+    uint8_t  req;
+    uint16_t value, index, length;
+    uint8_t  stall;     // Host expects a request error here
+} HostReq;
+
+#define HOST_RESET 0xFF
+#define RESET { HOST_RESET, 0, 0, 0, 0, 0 }
+#define GET_DESC(value, index, length) { 0x80, USB_GET_DESCRIPTOR, value, index, length, 0 }
+
+#define CFG_TOTAL (MyCfgDescr[2] | (MyCfgDescr[3] << 8))
+#define REPORT_LEN sizeof(MyHIDReportDescr)
+
+static uint8_t host_buf[1024];
+static uint16_t host_len;
+static uint32_t host_retries;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void Host_BusReset(void) {
+    R8_USB_INT_FG = RB_UIF_BUS_RST;
+    USB_DevTransProcess();
+}
+
+/**
+ * One IN packet on EP0 with toggle tog, appended to host_buf
+ */
+static XferResult Host_In(uint8_t tog, uint8_t *n) {
+    uint8_t ctrl = R8_UEP0_CTRL;
+
+    if ((ctrl & MASK_UEP_T_RES) == UEP_T_RES_STALL) return XFER_STALL;
+    if ((ctrl & MASK_UEP_T_RES) == UEP_T_RES_NAK) return XFER_NAK;
+    if (!!(ctrl & RB_UEP_T_TOG) != tog) return XFER_TOGGLE;
+    *n = R8_UEP0_T_LEN;
+    memcpy(host_buf + host_len, EP0_Databuf, *n);
+    host_len += *n;
+    BenchUsb_Token(UIS_TOKEN_IN | 0, 0);
+    return XFER_OK;
+}
+
+/**
+ * One OUT packet on EP0 with toggle tog. The SIE ACKs a toggle mismatch too,
+ * but flags it; XFER_TOGGLE tells the caller the device expected the other one.
+ */
+static XferResult Host_Out(uint8_t tog, const uint8_t *data, uint8_t len) {
+    uint8_t ctrl = R8_UEP0_CTRL;
+    uint8_t match = !!(ctrl & RB_UEP_R_TOG) == tog;
+
+    if ((ctrl & MASK_UEP_R_RES) == UEP_R_RES_STALL) return XFER_STALL;
+    if ((ctrl & MASK_UEP_R_RES) == UEP_R_RES_NAK) return XFER_NAK;
+    memcpy(EP0_Databuf, data, len);
+    R8_USB_RX_LEN = len;
+    R8_USB_INT_ST = UIS_TOKEN_OUT | 0 | (match ? RB_UIS_TOG_OK : 0);
+    R8_USB_INT_FG = RB_UIF_TRANSFER;
+    USB_DevTransProcess();
+    return match ? XFER_OK : XFER_TOGGLE;
+}
+
+/**
+ * A whole control transfer: SETUP, data stage, status stage
+ */
+static XferResult Host_Control(const HostReq *r, const uint8_t *out) {
+    XferResult res;
+    uint8_t n, tog = 1;
+
+    host_len = 0;
+    BenchUsb_Setup(r->type, r->req, r->value, r->index, r->length);
+    if (r->type & USB_REQ_TYP_IN) {
+        do {
+            if ((res = Host_In(tog, &n)) != XFER_OK) return res;
+            tog ^= 1;
+        } while (n == DevEP0SIZE && host_len < r->length);
+        if (host_len > r->length) return XFER_LENGTH;
+        return Host_Out(1, NULL, 0);
+    }
+    if (r->length && (res = Host_Out(1, out, r->length)) != XFER_OK) return res;
+    if ((res = Host_In(1, &n)) != XFER_OK) return res;
+    return n ? XFER_LENGTH : XFER_OK;
+}
+
+/**
+ * Run a script; an unexpected STALL counts as a host retry
+ */
+static void Host_Run(const char *name, const HostReq *s, uint32_t n) {
+    static const uint8_t led = 0x00;
+    char msg[64];
+
+    host_retries = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        XferResult res;
+
+        if (s[i].type == HOST_RESET) {
+            Host_BusReset();
+            continue;
+        }
+        res = Host_Control(&s[i], &led);
+        snprintf(msg, sizeof(msg), "%s step %u req %02X %04X", name, (unsigned)i, s[i].req, s[i].value);
+        if (s[i].stall) {
+            TEST_ASSERT_EQUAL_MESSAGE(XFER_STALL, res, msg);
+            continue;
+        }
+        if (res == XFER_STALL) host_retries++;
+        TEST_ASSERT_EQUAL_MESSAGE(XFER_OK, res, msg);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, host_retries);
+    TEST_ASSERT_EQUAL(USB_STATE_CONFIGURED, UsbState);
+}
+
+// Windows 10: 64-byte device descriptor probe before SET_ADDRESS, then the
+// MS OS descriptor probe, strings, a second descriptor pass and configuration.
+static const HostReq win10[] = {
+    RESET,
+    GET_DESC(0x0100, 0, 64),
+    RESET,
+    { 0x00, USB_SET_ADDRESS, 0x0B, 0, 0, 0 },
+    GET_DESC(0x0100, 0, 18),
+    GET_DESC(0x0200, 0, 255),
+    { 0x80, USB_GET_DESCRIPTOR, 0x03EE, 0, 0x12, 1 },
+    GET_DESC(0x0300, 0, 255),
+    GET_DESC(0x0302, 0x0409, 255),
+    GET_DESC(0x0303, 0x0409, 255),
+    GET_DESC(0x0100, 0, 18),
+    GET_DESC(0x0200, 0, 9),
+    GET_DESC(0x0200, 0, 0),     // Patched to wTotalLength below
+    { 0x80, USB_GET_STATUS, 0, 0, 2, 0 },
+    { 0x00, USB_SET_CONFIGURATION, 1, 0, 0, 0 },
+    { 0x21, HID_SET_IDLE, 0, 0, 0, 0 },
+    { 0x81, USB_GET_DESCRIPTOR, 0x2200, 0, 0, 0 },  // Patched to report length + 0x40
+    { 0x21, HID_SET_REPORT, 0x0200, 0, 1, 0 },
+};
+
+// Linux: usbcore's 64-byte probe, then configuration header and whole, strings
+// in manufacturer/product/serial order, then usbhid's SET_IDLE and report map.
+static const HostReq linux_hub[] = {
+    RESET,
+    GET_DESC(0x0100, 0, 64),
+    RESET,
+    { 0x00, USB_SET_ADDRESS, 0x03, 0, 0, 0 },
+    GET_DESC(0x0100, 0, 18),
+    GET_DESC(0x0200, 0, 9),
+    GET_DESC(0x0200, 0, 0),     // wTotalLength
+    GET_DESC(0x0300, 0, 255),
+    GET_DESC(0x0302, 0x0409, 255),
+    GET_DESC(0x0301, 0x0409, 255),
+    GET_DESC(0x0303, 0x0409, 255),
+    { 0x00, USB_SET_CONFIGURATION, 1, 0, 0, 0 },
+    { 0x21, HID_SET_IDLE, 0, 0, 0, 0 },
+    { 0x81, USB_GET_DESCRIPTOR, 0x2200, 0, 0, 0 },  // Report length
+    { 0x21, HID_SET_REPORT, 0x0200, 0, 1, 0 },
+};
+
+// macOS: 8-byte device descriptor probe, strings read as 2-byte header then
+// whole, GET_STATUS before SET_CONFIGURATION, report protocol selected.
+static const HostReq macos[] = {
+    RESET,
+    GET_DESC(0x0100, 0, 8),
+    RESET,
+    { 0x00, USB_SET_ADDRESS, 0x02, 0, 0, 0 },
+    GET_DESC(0x0100, 0, 18),
+    GET_DESC(0x0200, 0, 9),
+    GET_DESC(0x0200, 0, 0),     // wTotalLength
+    GET_DESC(0x0300, 0, 2),
+    GET_DESC(0x0300, 0, 4),
+    GET_DESC(0x0302, 0x0409, 2),
+    GET_DESC(0x0302, 0x0409, 0x12),
+    GET_DESC(0x0301, 0x0409, 2),
+    GET_DESC(0x0301, 0x0409, 0x10),
+    GET_DESC(0x0303, 0x0409, 2),
+    GET_DESC(0x0303, 0x0409, 0x22),
+    { 0x80, USB_GET_STATUS, 0, 0, 2, 0 },
+    { 0x00, USB_SET_CONFIGURATION, 1, 0, 0, 0 },
+    { 0x21, HID_SET_IDLE, 0, 0, 0, 0 },
+    { 0x21, HID_SET_PROTOCOL, 1, 0, 0, 0 },
+    { 0x81, USB_GET_DESCRIPTOR, 0x2200, 0, 0, 0 },  // Report length
+    { 0x21, HID_SET_REPORT, 0x0200, 0, 1, 0 },
+};
+
+/**
+ * Copy a script and fill in the lengths that depend on the descriptors
+ */
+static uint32_t Script_Load(HostReq *dst, const HostReq *src, uint32_t n, uint16_t report_extra) {
+    for (uint32_t i = 0; i < n; i++) {
+        dst[i] = src[i];
+        if (dst[i].req != USB_GET_DESCRIPTOR || dst[i].length) continue;
+        if (dst[i].value == 0x0200) dst[i].length = CFG_TOTAL;
+        if (dst[i].value == 0x2200) dst[i].length = REPORT_LEN + report_extra;
+    }
+    return n;
+}
+
+static HostReq script[32];
+
+void test_windows(void) {
+    uint32_t stalls = UsbStallCount;
+    Host_Run("win10", script, Script_Load(script, win10, sizeof(win10) / sizeof(win10[0]), 0x40));
+    TEST_ASSERT_EQUAL_UINT32(1, UsbStallCount - stalls);    // MS OS descriptor probe only
+    TEST_ASSERT_EQUAL_HEX8(0x0B, R8_USB_DEV_AD & ~RB_UDA_GP_BIT);
+}
+
+void test_linux(void) {
+    uint32_t stalls = UsbStallCount;
+    Host_Run("linux", script, Script_Load(script, linux_hub, sizeof(linux_hub) / sizeof(linux_hub[0]), 0));
+    TEST_ASSERT_EQUAL_UINT32(0, UsbStallCount - stalls);
+    TEST_ASSERT_EQUAL_HEX8(0x03, R8_USB_DEV_AD & ~RB_UDA_GP_BIT);
+}
+
+void test_macos(void) {
+    uint32_t stalls = UsbStallCount;
+    Host_Run("macos", script, Script_Load(script, macos, sizeof(macos) / sizeof(macos[0]), 0));
+    TEST_ASSERT_EQUAL_UINT32(0, UsbStallCount - stalls);
+    TEST_ASSERT_EQUAL_HEX8(0x02, R8_USB_DEV_AD & ~RB_UDA_GP_BIT);
+    TEST_ASSERT_EQUAL_UINT8(1, UsbProtocol);
+}
+
+// The replies themselves: lengths capped at wLength, multi-packet stages intact
+void test_descriptor_replies(void) {
+    HostReq r = GET_DESC(0x0100, 0, 8);
+
+    TEST_ASSERT_EQUAL(XFER_OK, Host_Control(&r, NULL));
+    TEST_ASSERT_EQUAL_UINT16(8, host_len);
+    r.length = 64;
+    TEST_ASSERT_EQUAL(XFER_OK, Host_Control(&r, NULL));
+    TEST_ASSERT_EQUAL_UINT16(sizeof(MyDevDescr), host_len);
+    TEST_ASSERT_EQUAL_MEMORY(MyDevDescr, host_buf, sizeof(MyDevDescr));
+
+    r.value = 0x0200;
+    r.length = 255;
+    TEST_ASSERT_EQUAL(XFER_OK, Host_Control(&r, NULL));
+    TEST_ASSERT_EQUAL_UINT16(CFG_TOTAL, host_len);
+    TEST_ASSERT_EQUAL_MEMORY(MyCfgDescr, host_buf, CFG_TOTAL);
+
+    r.type = 0x81;
+    r.value = 0x2200;
+    r.length = REPORT_LEN + 0x40;
+    TEST_ASSERT_EQUAL(XFER_OK, Host_Control(&r, NULL));
+    TEST_ASSERT_EQUAL_UINT16(REPORT_LEN, host_len);
+    TEST_ASSERT_EQUAL_MEMORY(MyHIDReportDescr, host_buf, REPORT_LEN);
+}
+
+// A resent OUT data packet (the device's ACK was lost) must not be taken for
+// the status stage: the transfer still completes and the data is kept once.
+void test_out_retransmission(void) {
+    const uint8_t caps = 0x02, stale = 0x07;
+    uint8_t n;
+
+    BenchUsb_Setup(0x21, HID_SET_REPORT, 0x0200, 0, 1);
+    TEST_ASSERT_EQUAL(XFER_OK, Host_Out(1, &caps, 1));
+    TEST_ASSERT_EQUAL(XFER_TOGGLE, Host_Out(1, &stale, 1));
+    TEST_ASSERT_EQUAL_HEX8(caps, UsbLedState);
+    host_len = 0;
+    TEST_ASSERT_EQUAL(XFER_OK, Host_In(1, &n));
+    TEST_ASSERT_EQUAL_UINT8(0, n);
+
+    // Resent status OUT of an IN request after its ACK got lost
+    BenchUsb_Setup(0x80, USB_GET_STATUS, 0, 0, 2);
+    TEST_ASSERT_EQUAL(XFER_OK, Host_In(1, &n));
+    TEST_ASSERT_EQUAL(XFER_OK, Host_Out(1, NULL, 0));
+    TEST_ASSERT_EQUAL(XFER_TOGGLE, Host_Out(1, NULL, 0));
+    TEST_ASSERT_EQUAL_HEX8(UEP_R_RES_ACK | UEP_T_RES_NAK, R8_UEP0_CTRL & (MASK_UEP_R_RES | MASK_UEP_T_RES));
+}
+
+void test_no_heap(void) {
+    uint32_t allocs = bench_allocs;
+    Host_Run("linux", script, Script_Load(script, linux_hub, sizeof(linux_hub) / sizeof(linux_hub[0]), 0));
+    TEST_ASSERT_EQUAL_UINT32(allocs, bench_allocs);
+}
+
+int main(void) {
+    USB_InitSerial();
+    UNITY_BEGIN();
+    RUN_TEST(test_windows);
+    RUN_TEST(test_linux);
+    RUN_TEST(test_macos);
+    RUN_TEST(test_descriptor_replies);
+    RUN_TEST(test_out_retransmission);
+    RUN_TEST(test_no_heap);
+    return UNITY_END();
+}
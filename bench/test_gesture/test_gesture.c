@@ -0,0 +1,257 @@
+// --- Gesture recogniser tests (native env, see platformio.ini) ---
+//
+// gesture.h on synthetic event sequences placed right at and just past each
+// timing threshold (tap length, double tap gap, long press hold, swipe gap),
+// plus the direction and distance rules of a swipe. The last test replays a
+// session written in the "E,<t_us>,<key>,<down>" event trace format (not a board
+// capture) the way the main loop feeds it: events of a sweep first, then
+// Gesture_Tick(), one sweep every 10 ms.
+
+#include <unity.h>
+#include "CH58x_common.h"
+#include "bench.h"
+#include "touch.h"
+#include "touch_event.h"
+#include "gesture.h"
+
+#define MS 1000u
+#define SWEEP_MS 10
+
+static GestureState g;
+
+void setUp(void) {
+    memset(&g, 0, sizeof(g));
+    g.enabled = 1;
+    TouchCfg_Defaults();
+}
+
+void tearDown(void) {}
+
+static void Ev(uint32_t ms, uint8_t key, uint8_t down) {
+    TouchEvent e = { ms * MS, key, down };
+    Gesture_Event(&g, &e);
+}
+
+static void Tap(uint32_t ms, uint32_t len_ms, uint8_t key) {
+    Ev(ms, key, 1);
+    Ev(ms + len_ms, key, 0);
+}
+
+static void Tick(uint32_t ms) {
+    Gesture_Tick(&g, ms * MS);
+}
+
+static void Expect(uint8_t type, uint8_t key) {
+    Gesture ge = { 0 };
+    TEST_ASSERT_TRUE_MESSAGE(Gesture_Pop(&g, &ge), "gesture missing");
+    TEST_ASSERT_EQUAL_UINT8(type, ge.type);
+    TEST_ASSERT_EQUAL_UINT8(key, ge.key);
+}
+
+static void ExpectNone(void) {
+    Gesture ge;
+    TEST_ASSERT_FALSE(Gesture_Pop(&g, &ge));
+}
+
+// --- Tap ---
+
+void test_tap_at_max_length(void) {
+    Tap(1000, GESTURE_TAP_MAX_MS, 1);
+    Tick(1000 + GESTURE_TAP_MAX_MS + GESTURE_DOUBLE_GAP_MS);
+    ExpectNone();                       // Held back while a double tap is possible
+    Tick(1000 + GESTURE_TAP_MAX_MS + GESTURE_DOUBLE_GAP_MS + 1);
+    Expect(GESTURE_TAP, 1);
+    ExpectNone();
+}
+
+void test_tap_too_long(void) {
+    Tap(1000, GESTURE_TAP_MAX_MS + 1, 1);
+    Tick(3000);
+    ExpectNone();
+}
+
+void test_tap_code(void) {
+    Gesture ge = { GESTURE_TAP, 2 };
+    TEST_ASSERT_EQUAL_HEX16(touch_cfg.key_map[2], Gesture_Code(&ge));
+    ge.type = GESTURE_DOUBLE_TAP;
+    TEST_ASSERT_EQUAL_HEX16(gesture_map[GESTURE_DOUBLE_TAP], Gesture_Code(&ge));
+}
+
+// --- Double tap ---
+
+void test_double_tap_at_max_gap(void) {
+    Tap(1000, 100, 0);
+    Tap(1100 + GESTURE_DOUBLE_GAP_MS, 100, 0);
+    Expect(GESTURE_DOUBLE_TAP, 0);
+    Tick(5000);
+    ExpectNone();
+}
+
+void test_double_tap_gap_too_long(void) {
+    Tap(1000, 100, 0);
+    Tap(1100 + GESTURE_DOUBLE_GAP_MS + 1, 100, 0);
+    Tick(5000);
+    Expect(GESTURE_TAP, 0);
+    Expect(GESTURE_TAP, 0);
+    ExpectNone();
+}
+
+void test_double_tap_needs_same_key(void) {
+    Tap(1000, 100, 0);
+    Tap(1200, 100, 2);
+    Tick(5000);
+    Expect(GESTURE_TAP, 0);
+    Expect(GESTURE_TAP, 2);
+    ExpectNone();
+}
+
+// --- Long press ---
+
+void test_long_press_threshold(void) {
+    Ev(1000, 1, 1);
+    Tick(1000 + GESTURE_LONG_MS - 1);
+    ExpectNone();
+    Tick(1000 + GESTURE_LONG_MS);
+    Expect(GESTURE_LONG_PRESS, 1);
+    Tick(1000 + GESTURE_LONG_MS + 500);
+    Ev(2000, 1, 0);
+    Tick(5000);
+    ExpectNone();                       // Once per hold, and the release is no tap
+}
+
+void test_long_press_single_key_only(void) {
+    Ev(1000, 0, 1);
+    Ev(1010, 2, 1);
+    Tick(1000 + GESTURE_LONG_MS + 100);
+    ExpectNone();
+}
+
+// --- Swipe: direction and distance ---
+
+void test_swipe_forward(void) {
+    Tap(1000, 80, 0);
+    Tap(1000 + GESTURE_SWIPE_GAP_MS, 80, 1);
+    Ev(1000 + 2 * GESTURE_SWIPE_GAP_MS, 2, 1);
+    Expect(GESTURE_SWIPE_FWD, 2);
+    Ev(1500, 2, 0);
+    Tick(5000);
+    ExpectNone();                       // The taps on the way were the swipe
+}
+
+void test_swipe_back(void) {
+    Tap(1000, 80, 2);
+    Tap(1100, 80, 1);
+    Ev(1200, 0, 1);
+    Expect(GESTURE_SWIPE_BACK, 0);
+    Ev(1250, 0, 0);
+    Tick(5000);
+    ExpectNone();
+}
+
+void test_swipe_with_overlapping_touches(void) {
+    // Finger slides: the next pad is touched before the last one lets go
+    Ev(1000, 0, 1);
+    Ev(1060, 1, 1);
+    Ev(1090, 0, 0);
+    Ev(1120, 2, 1);
+    Expect(GESTURE_SWIPE_FWD, 2);
+    Ev(1150, 1, 0);
+    Ev(1200, 2, 0);
+    Tick(5000);
+    ExpectNone();
+}
+
+void test_swipe_gap_too_long(void) {
+    Tap(1000, 50, 0);
+    Tap(1000 + GESTURE_SWIPE_GAP_MS + 1, 50, 1);
+    Tap(1000 + 2 * GESTURE_SWIPE_GAP_MS, 50, 2);
+    Tick(5000);
+    Expect(GESTURE_TAP, 0);
+    Expect(GESTURE_TAP, 1);
+    Expect(GESTURE_TAP, 2);
+    ExpectNone();
+}
+
+void test_swipe_direction_change(void) {
+    Tap(1000, 50, 0);
+    Tap(1100, 50, 1);
+    Tap(1200, 50, 0);
+    Tick(5000);
+    Expect(GESTURE_TAP, 0);
+    Expect(GESTURE_TAP, 1);
+    Expect(GESTURE_TAP, 0);
+    ExpectNone();
+}
+
+void test_swipe_skipping_a_key(void) {
+    Tap(1000, 50, 0);
+    Tap(1100, 50, 2);
+    Tick(5000);
+    Expect(GESTURE_TAP, 0);
+    Expect(GESTURE_TAP, 2);
+    ExpectNone();
+}
+
+// --- Replayed session ---
+
+// Tap, double tap, swipe forward, long press, swipe back, in sweep-quantised times
+static const char *session[] = {
+    "E,1000000,1,1", "E,1120000,1,0",                                           // Tap UP
+    "E,2000000,0,1", "E,2080000,0,0", "E,2250000,0,1", "E,2330000,0,0",         // Double tap LEFT
+    "E,3000000,0,1", "E,3070000,1,1", "E,3090000,0,0", "E,3150000,2,1",         // Swipe forward
+    "E,3160000,1,0", "E,3230000,2,0",
+    "E,4000000,2,1", "E,4900000,2,0",                                           // Long press RIGHT
+    "E,6000000,2,1", "E,6050000,2,0", "E,6120000,1,1", "E,6170000,1,0",         // Swipe back
+    "E,6240000,0,1", "E,6300000,0,0",
+};
+
+static const Gesture session_expect[] = {
+    { GESTURE_TAP, 1 }, { GESTURE_DOUBLE_TAP, 0 }, { GESTURE_SWIPE_FWD, 2 },
+    { GESTURE_LONG_PRESS, 2 }, { GESTURE_SWIPE_BACK, 0 },
+};
+
+void test_replay_session(void) {
+    uint32_t n = sizeof(session) / sizeof(session[0]);
+    uint32_t i = 0, got = 0;
+    unsigned long t_us;
+    unsigned key, down;
+    Gesture ge;
+
+    for (uint32_t t = 0; t <= 8000000; t += SWEEP_MS * MS) {
+        while (i < n && sscanf(session[i], "E,%lu,%u,%u", &t_us, &key, &down) == 3 && t_us == t) {
+            TouchEvent e = { t_us, key, down };
+            Gesture_Event(&g, &e);
+            i++;
+        }
+        Gesture_Tick(&g, t);
+        while (Gesture_Pop(&g, &ge)) {
+            TEST_ASSERT_TRUE_MESSAGE(got < sizeof(session_expect) / sizeof(session_expect[0]), "extra gesture");
+            TEST_ASSERT_EQUAL_UINT8(session_expect[got].type, ge.type);
+            TEST_ASSERT_EQUAL_UINT8(session_expect[got].key, ge.key);
+            got++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(n, i);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(session_expect) / sizeof(session_expect[0]), got);
+    TEST_ASSERT_EQUAL_UINT32(0, g.lost);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_tap_at_max_length);
+    RUN_TEST(test_tap_too_long);
+    RUN_TEST(test_tap_code);
+    RUN_TEST(test_double_tap_at_max_gap);
+    RUN_TEST(test_double_tap_gap_too_long);
+    RUN_TEST(test_double_tap_needs_same_key);
+    RUN_TEST(test_long_press_threshold);
+    RUN_TEST(test_long_press_single_key_only);
+    RUN_TEST(test_swipe_forward);
+    RUN_TEST(test_swipe_back);
+    RUN_TEST(test_swipe_with_overlapping_touches);
+    RUN_TEST(test_swipe_gap_too_long);
+    RUN_TEST(test_swipe_direction_change);
+    RUN_TEST(test_swipe_skipping_a_key);
+    RUN_TEST(test_replay_session);
+    return UNITY_END();
+}
@@ -0,0 +1,69 @@
+// --- Logger benchmark (native env, see platformio.ini) ---
+//
+// The firmware's own log paths: the "T," and "E," trace lines the main loop
+// prints with "trace 1", pushed through debug.h's _write() into UART1 as printf
+// does, and the USB enumeration trace (USB_TraceAdd). The lines are formatted
+// once up front: on the target printf is newlib's, so timing the host libc's
+// formatting would say nothing about the firmware.
+
+#include <unity.h>
+#include "bench.h"
+#include "bench_usb.h"
+#include "debug.h"
+
+#define LINES 8                 // Distinct lines cycled through, so not every write is the same length
+
+UartRegs uart1_regs;
+
+static char trace_line[LINES][48];
+static char event_line[LINES][32];
+static int trace_len[LINES], event_len[LINES];
+
+void setUp(void) {
+    DebugInit();
+    for (uint32_t i = 0; i < LINES; i++) {
+        uint32_t t = 0x8000000u + i * 997;  // Realistic widths: timestamps hours into a session
+        trace_len[i] = snprintf(trace_line[i], sizeof(trace_line[i]), "T,%lu,%d,%d,%d,%d\n", (unsigned long)t,
+            (int)(i % 3), (int)(t & 0xFF) - 128, (int)(t & 0x7F), -(int)(t & 0x3F));
+        event_len[i] = snprintf(event_line[i], sizeof(event_line[i]), "E,%lu,%u,%u\n", (unsigned long)t, i % 3, i & 1);
+    }
+}
+
+void tearDown(void) {}
+
+static void Bench_TraceLine(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) bench_sink += _write(1, trace_line[i % LINES], trace_len[i % LINES]);
+}
+
+static void Bench_EventLine(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) bench_sink += _write(1, event_line[i % LINES], event_len[i % LINES]);
+}
+
+static void Bench_UsbTrace(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        UsbTraceCount = i & (USB_TRACE_LEN - 1);
+        USB_TraceAdd((i & 7) ? USB_TRACE_OK : USB_TRACE_RESET);
+    }
+}
+
+void test_trace_line(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("log.trace_line", Bench_TraceLine, 1000000));
+    TEST_ASSERT_EQUAL_UINT32(0, HwPollTimeouts);
+}
+
+void test_event_line(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("log.event_line", Bench_EventLine, 1000000));
+    TEST_ASSERT_EQUAL_UINT32(0, HwPollTimeouts);
+}
+
+void test_usb_trace(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("log.usb_trace", Bench_UsbTrace, 2000000));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_trace_line);
+    RUN_TEST(test_event_line);
+    RUN_TEST(test_usb_trace);
+    return UNITY_END();
+}
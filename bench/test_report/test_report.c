@@ -0,0 +1,117 @@
+// --- Report builder benchmark (native env, see platformio.ini) ---
+//
+// Packing in every layout hid_report.h offers, and the queue path the main
+// loop takes on a key change: HidQueue_PushChanged() then Hid_Flush() into a
+// transport that is always ready.
+
+#include <unity.h>
+#include "CH58x_common.h"
+#include "bench.h"
+#include "hid_report.h"
+
+static const uint8_t codes[8] = { 0x04, 0x05, 0x50, 0x4F, 0x52, 0x51, 0x28, 0x2C };
+
+static uint8_t Bench_Ready(void) {
+    return 1;
+}
+
+static void Bench_Send(uint8_t ch, const uint8_t *buf, uint8_t len) {
+    bench_sink += buf[len - 1] + ch;
+}
+
+static const HidTransport bench_transport = { "bench", Bench_Ready, Bench_Send, 1 };
+
+static HidQueue q;
+static HidReport last;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void Bench_PackBoot(uint32_t iters) {
+    uint8_t out[HID_REPORT_MAX];
+    for (uint32_t i = 0; i < iters; i++) bench_sink += Report_PackKeys(out, 1, 0, codes, i & 7);
+}
+
+static void Bench_PackNkro(uint32_t iters) {
+    uint8_t out[HID_NKRO_LEN];
+    for (uint32_t i = 0; i < iters; i++) bench_sink += Report_PackNkro(out, 0, codes, i & 7) + out[1];
+}
+
+static void Bench_PackConsumer(uint32_t iters) {
+    uint8_t out[HID_CONSUMER_LEN];
+    for (uint32_t i = 0; i < iters; i++) bench_sink += Report_PackConsumer(out, i & 0x3FF) + out[1];
+}
+
+static void Bench_QueueFlush(uint32_t iters) {
+    uint8_t out[HID_REPORT_MAX], len;
+    for (uint32_t i = 0; i < iters; i++) {
+        // Press and release alternate, every other one repeats and is filtered
+        len = Report_PackKeys(out, 0, 0, codes, (i >> 1) & 1);
+        HidQueue_PushChanged(&q, &last, HID_CH_KEYBOARD, out, len);
+        Hid_Flush(&q, &bench_transport);
+    }
+}
+
+void test_pack_boot(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("report.pack_boot", Bench_PackBoot, 2000000));
+}
+
+void test_pack_nkro(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("report.pack_nkro", Bench_PackNkro, 2000000));
+}
+
+void test_pack_consumer(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("report.pack_consumer", Bench_PackConsumer, 2000000));
+}
+
+void test_queue_flush(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("report.queue_flush", Bench_QueueFlush, 2000000));
+    TEST_ASSERT_EQUAL_UINT32(0, q.dropped);
+    TEST_ASSERT_TRUE(HidQueue_Empty(&q));
+}
+
+void test_queue_free(void) {
+    // Gesture taps rely on this to reserve room for press and release
+    uint8_t out[HID_REPORT_MAX] = { 0 };
+    TEST_ASSERT_EQUAL_UINT8(HID_QUEUE_LEN - 1, HidQueue_Free(&q));
+    while (HidQueue_Push(&q, HID_CH_KEYBOARD, out, 8)) {}
+    TEST_ASSERT_EQUAL_UINT8(0, HidQueue_Free(&q));
+    Hid_Flush(&q, &bench_transport);
+    TEST_ASSERT_EQUAL_UINT8(1, HidQueue_Free(&q));
+    while (Hid_Flush(&q, &bench_transport)) {}
+    TEST_ASSERT_EQUAL_UINT8(HID_QUEUE_LEN - 1, HidQueue_Free(&q));
+    TEST_ASSERT_EQUAL_UINT32(0, q.dropped);
+}
+
+void test_queue_full_retry(void) {
+    // Held key while the host takes nothing: retried every scan, nothing lost
+    uint8_t out[HID_REPORT_MAX] = { 0 }, len;
+    HidReport sent = { 0 };
+    while (HidQueue_Push(&q, HID_CH_KEYBOARD, out, 8)) {}
+    len = Report_PackKeys(out, 1, 0, codes, 1);
+    for (int i = 0; i < 100; i++) TEST_ASSERT_FALSE(HidQueue_PushChanged(&q, &sent, HID_CH_KEYBOARD, out, len));
+    TEST_ASSERT_EQUAL_UINT32(0, q.dropped);
+
+    // A second key before the first got through: the one-key report is lost
+    len = Report_PackKeys(out, 1, 0, codes, 2);
+    TEST_ASSERT_FALSE(HidQueue_PushChanged(&q, &sent, HID_CH_KEYBOARD, out, len));
+    TEST_ASSERT_EQUAL_UINT32(1, q.dropped);
+
+    // Room again: the retry goes out and the count stays
+    while (Hid_Flush(&q, &bench_transport)) {}
+    TEST_ASSERT_TRUE(HidQueue_PushChanged(&q, &sent, HID_CH_KEYBOARD, out, len));
+    TEST_ASSERT_EQUAL_UINT32(1, q.dropped);
+    while (Hid_Flush(&q, &bench_transport)) {}
+    q.dropped = 0;
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_pack_boot);
+    RUN_TEST(test_pack_nkro);
+    RUN_TEST(test_pack_consumer);
+    RUN_TEST(test_queue_flush);
+    RUN_TEST(test_queue_free);
+    RUN_TEST(test_queue_full_retry);
+    return UNITY_END();
+}
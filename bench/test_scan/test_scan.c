@@ -0,0 +1,148 @@
+// --- Scan pipeline benchmark (native env, see platformio.ini) ---
+//
+// One sweep the way the main loop handles it (main.c: TMR0_IRQHandler publish,
+// Touch_Process, Touch_Classify and the per-key loop): scan clock publish/take,
+// hop median, frame classifier, debounce, touch events and the gesture
+// recogniser. The input cycles through idle, a finger on each key in turn, a
+// hand approaching and a water film, so every branch gets its share.
+
+#include <unity.h>
+#include "CH58x_common.h"
+#include "bench.h"
+#include "touch.h"
+#include "touch_frame.h"
+#include "scan_clock.h"
+#include "touch_event.h"
+#include "gesture.h"
+
+#define PATTERN_LEN 64
+#define PATTERN_BASE 2000       // Untouched raw reading
+
+static ScanFrame pattern[PATTERN_LEN];
+
+static void Pattern_Init(void) {
+    for (int i = 0; i < PATTERN_LEN; i++) {
+        for (int k = 0; k < NUM_KEYS; k++) {
+            for (int h = 0; h < TOUCH_HOPS; h++) {
+                int raw = PATTERN_BASE + (i * 7 + k * 3 + h * 5) % 9 - 4;
+                switch (i / 16) {
+                case 1: if (k == (i / 4) % NUM_KEYS) raw -= 300; break;  // Finger
+                case 2: raw -= 30; break;                                 // Hand close by
+                case 3: raw -= 100; break;                                // Water film
+                }
+                pattern[i].raw[k][h] = raw;
+            }
+        }
+    }
+}
+
+void setUp(void) {
+    TouchCfg_Defaults();
+    for (int k = 0; k < NUM_KEYS; k++) {
+        for (int h = 0; h < TOUCH_HOPS; h++) touch_st.base_cal[k][h] = PATTERN_BASE;
+    }
+    ScanClock_Configure(&scan_clk, 60000000, TOUCH_SCAN_HZ);
+    gesture.enabled = 1;
+}
+
+void tearDown(void) {}
+
+static void Sweep(const ScanFrame *src) {
+    const ScanFrame *f;
+    TouchEvent ev;
+    Gesture ge;
+    uint8_t suppress;
+
+    // ISR side; the copy stands in for Touch_Acquire()
+    memcpy(ScanClock_WriteBuf(&scan_clk)->raw, src->raw, sizeof(src->raw));
+    ScanClock_Publish(&scan_clk, 30, 3000);
+
+    // Main loop side
+    f = ScanClock_Take(&scan_clk);
+    memcpy(touch_st.raw, f->raw, sizeof(touch_st.raw));
+    touch_st.t_us = f->t_us;
+    for (int k = 0; k < NUM_KEYS; k++) Touch_HopCombine(k);
+    suppress = Touch_FrameUpdate(Touch_ClassifyFrame(touch_st.delta, touch_cfg.thres, NUM_KEYS, 0));
+    for (int k = 0; k < NUM_KEYS; k++) {
+        uint8_t was = touch_st.pressed[k];
+        uint8_t pressed = Touch_Debounce(k, suppress ? 0 : touch_st.delta[k]);
+        if (pressed != was) TouchEvent_Push(&touch_ev, touch_st.t_us, k, pressed);
+    }
+    while (TouchEvent_Pop(&touch_ev, &ev)) Gesture_Event(&gesture, &ev);
+    Gesture_Tick(&gesture, touch_st.t_us);
+    while (Gesture_Pop(&gesture, &ge)) bench_sink += Gesture_Code(&ge);
+}
+
+static void Bench_Sweep(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) Sweep(&pattern[i % PATTERN_LEN]);
+}
+
+static void Bench_HopCombine(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        memcpy(touch_st.raw, pattern[i % PATTERN_LEN].raw, sizeof(touch_st.raw));
+        for (int k = 0; k < NUM_KEYS; k++) bench_sink += Touch_HopCombine(k);
+    }
+}
+
+static void Bench_Classify(uint32_t iters) {
+    static const int16_t deltas[4][NUM_KEYS] = { { 0 }, { 300 }, { 30, 30, 30 }, { 100, 100, 100 } };
+    for (uint32_t i = 0; i < iters; i++) {
+        bench_sink += Touch_FrameUpdate(Touch_ClassifyFrame(deltas[i & 3], touch_cfg.thres, NUM_KEYS, 0));
+    }
+}
+
+static void Bench_Gesture(uint32_t iters) {
+    TouchEvent ev;
+    Gesture ge;
+    uint32_t t = 0;
+
+    // Alternate taps and swipes, 100 ms apart
+    for (uint32_t i = 0; i < iters; i++) {
+        ev.t_us = t;
+        ev.key = (i >> 1) % NUM_KEYS;
+        ev.down = !(i & 1);
+        Gesture_Event(&gesture, &ev);
+        Gesture_Tick(&gesture, t);
+        while (Gesture_Pop(&gesture, &ge)) bench_sink += ge.type;
+        t += 100000;
+    }
+}
+
+void test_sweep(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("scan.sweep", Bench_Sweep, 200000));
+    TEST_ASSERT_TRUE(touch_frame.count[FRAME_TOUCH] > 0);
+    TEST_ASSERT_TRUE(touch_frame.count[FRAME_WATER] > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, scan_clk.overruns);
+}
+
+void test_hop_combine(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("scan.hop_combine", Bench_HopCombine, 200000));
+}
+
+void test_classify(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("scan.classify", Bench_Classify, 1000000));
+}
+
+void test_gesture(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, Bench_Run("scan.gesture", Bench_Gesture, 1000000));
+}
+
+void test_max_hz(void) {
+    // 60 MHz: 500 us sweep + 1 us entry latency, twice over => 998 Hz
+    ScanClock_ResetTiming(&scan_clk);
+    TEST_ASSERT_EQUAL_UINT16(SCAN_HZ_MAX, ScanClock_MaxHz(&scan_clk));
+    ScanClock_Publish(&scan_clk, 60, 30000);
+    TEST_ASSERT_EQUAL_UINT16(998, ScanClock_MaxHz(&scan_clk));
+    ScanClock_Take(&scan_clk);
+}
+
+int main(void) {
+    Pattern_Init();
+    UNITY_BEGIN();
+    RUN_TEST(test_sweep);
+    RUN_TEST(test_hop_combine);
+    RUN_TEST(test_classify);
+    RUN_TEST(test_gesture);
+    RUN_TEST(test_max_hz);
+    return UNITY_END();
+}
@@ -0,0 +1,686 @@
+// --- Multi-device USB hub stress benchmark ---
+//
+// Runs N copies of the firmware USB device handler (usb_device.h, unchanged)
+// behind one simulated full-speed hub. A scripted host enumerates them after a
+// simultaneous power-up and then polls their keyboard endpoints, while port
+// resets and NAK storms are injected. Every firmware interrupt is a real call of
+// USB_DevTransProcess() on the host CPU.
+//
+// Build and run from the repository root:
+//
+//     gcc -O2 -Ibench/shim -Isrc bench/usb_hub/usb_hub_bench.c -o usb_hub_bench
+//     ./usb_hub_bench [-n devices] [-t seconds] [-r resets] [-s storm] [-j jitter] [-k key_ms] [-S seed]
+//
+//   -n  devices on the hub (1..127, default 32)
+//   -t  simulated bus time in seconds (default 10)
+//   -r  injected port resets per device and second (default 0.05)
+//   -s  share of every frame lost to a NAK storm from another device, % (default 0)
+//   -j  extra device interrupt latency, uniform 0..j us (default 50; the TMR0
+//       touch sweep holds off the USB interrupt on the target)
+//   -k  mean time between key events per device in ms (default 50)
+//
+// Model:
+//   - 1 ms frames of FRAME_BYTES bus bytes at 12 Mbit/s. Interrupt polls go
+//     first, then the storm share, then control transfers round-robin until the
+//     frame is full. A NAKed control stage is retried in the same frame.
+//   - The host enumerates one device at a time at address 0 (port reset,
+//     GET_DESCRIPTOR(device, 64), port reset, SET_ADDRESS, then the usual descriptor
+//     reads, SET_CONFIGURATION, SET_IDLE, report descriptor, SET_REPORT).
+//   - After a transaction the device raises its interrupt; until the handler has
+//     run (after the interrupt latency) the SIE NAKs every IN/OUT token.
+//   - A port reset takes the device off the schedule until the host gets to
+//     re-enumerate it (address 0 is shared, so it queues behind the others).
+//   - Key events fall on frame boundaries (1 in key_ms frames), are pushed into
+//     the device's HID queue and sent with Hid_Flush() as the firmware main loop does.
+//
+// Metrics (see bench.h for the line format):
+//   enum_ms          port reset (or attach) to end of enumeration, incl. waiting for address 0
+//   all_ready_ms     power-up until every device was enumerated once
+//   ep0_isr_ps       host CPU time of one EP0 / bus reset interrupt (ISR_BATCH average)
+//   ep1_isr_ps       host CPU time of one EP1 interrupt (ISR_BATCH average)
+//   isr_restore_ps   restoring the handler state between those runs, timed alone.
+//                    It overlaps with the handler on an out-of-order host core,
+//                    so the handler alone costs between ep*_isr_ps minus this
+//                    and ep*_isr_ps (bench/test_control times it without restores)
+//   ep0_isr_per_enum EP0 interrupts per enumeration
+//   report_us        key event to report delivered to the host
+// followed by bus counters. The isr figures are host CPU time: compare them
+// between runs on the same machine, not with target cycles.
+
+#include "CH58x_common.h"
+#include "../bench.h"
+#include "usb_device.h"
+
+UsbRegs *usb_regs;
+uint8_t *pEP0_RAM_Addr;
+uint8_t *pEP1_RAM_Addr;
+
+#define MAX_DEVICES 127
+
+#define FRAME_NS 1000000u
+#define FRAME_BYTES 1500        // 12 Mbit/s for 1 ms
+#define FRAME_USABLE 1350       // Minus SOF and end-of-frame guard time
+#define NS_PER_BYTE 667
+#define TX_OVERHEAD 13          // Token, data PID/CRC, handshake, sync, EOP, inter-packet gaps
+#define NAK_BYTES 9             // Token + NAK handshake
+#define TIMEOUT_BYTES 20        // Token + bus turnaround timeout
+
+#define ISR_ENTRY_NS 1000       // Interrupt entry without contention
+#define ISR_BATCH 64            // Handler runs per timed sample, see Isr_TimePs()
+#define ISR_REPEAT 3            // Timed samples per interrupt, the fastest counts
+#define ISR_CALIBRATE 10000     // Timed samples of the restore baseline
+
+#define PORT_RESET_NS (10 * 1000000ull)
+#define RESET_RECOVERY_NS (10 * 1000000ull)
+#define ATTACH_DEBOUNCE_NS (100 * 1000000ull)
+#define SET_ADDRESS_RECOVERY_NS (2 * 1000000ull)
+#define CTRL_TIMEOUT_NS (5000 * 1000000ull)
+#define CTRL_RETRIES 3          // Transactions without any response before the transfer fails
+
+// ====================================================================
+// === DEVICE INSTANCES ===
+// ====================================================================
+
+// Firmware globals that make up one device; swapped in before it runs
+#define DEV_STATE(X) \
+    X(DevConfig) X(Ready) X(UsbState) X(UsbStateBeforeSuspend) X(UsbRemoteWakeupEn) \
+    X(Ep1CtrlBeforeSuspend) X(SetupReqCode) X(SetupReqType) X(SetupReqLen) X(pDescr) \
+    X(UsbIdleRate) X(UsbProtocol) X(UsbLedState) X(HidLastReport) X(UsbReplyBuf) \
+    X(MySerialInfo) X(UsbSetupBuf) X(EP0_Databuf) X(EP1_Databuf) X(UsbTrace) \
+    X(UsbTraceCount) X(UsbStallCount) X(UsbBusResetCount) X(hid_q)
+
+// The part of it an interrupt changes or branches on, plus the first
+// ISR_EP0_BYTES of EP0_Databuf (SETUP packet, OUT data); the rest (trace
+// entries, reply data, queued reports) is written before it is read or not touched
+#define DEV_ISR_STATE(X) \
+    X(DevConfig) X(Ready) X(UsbState) X(UsbStateBeforeSuspend) X(UsbRemoteWakeupEn) \
+    X(Ep1CtrlBeforeSuspend) X(SetupReqCode) X(SetupReqType) X(SetupReqLen) X(pDescr) \
+    X(UsbIdleRate) X(UsbProtocol) X(UsbLedState) X(UsbSetupBuf) \
+    X(UsbTraceCount) X(UsbStallCount) X(UsbBusResetCount)
+#define ISR_EP0_BYTES 8
+
+typedef struct {
+#define X(v) uint8_t v[sizeof(v)];
+    DEV_STATE(X)
+#undef X
+} DevState;
+
+typedef struct {
+#define X(v) uint8_t v[sizeof(v)];
+    DEV_ISR_STATE(X)
+#undef X
+    uint8_t ep0[ISR_EP0_BYTES];
+} DevIsrState;
+
+typedef enum { CT_SETUP, CT_DATA_IN, CT_DATA_OUT, CT_STATUS_IN, CT_STATUS_OUT } CtrlStage;
+typedef enum { TX_ACK, TX_NAK, TX_STALL, TX_TIMEOUT } TxResult;
+typedef enum { H_ATTACH, H_LOCK, H_STEP, H_CTRL, H_READY } HostState;
+
+typedef struct {
+    // Device side
+    DevState st;                // Firmware globals while another instance runs
+    UsbRegs regs;
+    uint8_t index;
+    uint64_t isr_at;            // Pending interrupt runs at this time, 0 = none
+    uint64_t push_ns[HID_QUEUE_LEN];    // Key event time per queue slot
+    uint64_t ep1_ns;            // Key event time of the report in EP1
+    uint8_t ep1_busy;
+    uint8_t key_down;
+
+    // Host side
+    HostState hs;
+    uint8_t addr;               // Address the host uses
+    uint8_t step;               // Enumeration script position
+    uint64_t wait_until;
+    uint64_t enum_start;
+    uint32_t enum_isr;          // EP0 interrupts during this enumeration
+    uint8_t ever_ready;
+
+    // Control transfer in progress
+    CtrlStage stage;
+    USB_SETUP_REQ setup;
+    uint8_t out_data[8];
+    uint16_t got;
+    uint8_t retries;
+    uint64_t ctrl_start;
+} Dev;
+
+static Dev devs[MAX_DEVICES];
+static Dev *cur;
+static DevState pristine;
+
+static uint32_t rng = 1;
+
+static uint32_t Rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Statistics
+static Samples s_enum_ms, s_ep0_ps, s_ep1_ps, s_isr_per_enum, s_report_us;
+static uint64_t n_tx, n_nak, n_stall, n_timeout, n_storm_nak, n_enum_fail, n_resets, n_reports_lost;
+static uint64_t bus_bytes;
+static uint64_t all_ready_ns;
+
+void GetUniqueID(uint8_t *buf) {
+    memset(buf, 0, 8);
+    buf[0] = 0xB0;
+    buf[7] = cur ? cur->index : 0;
+}
+
+// No vendor requests on the hub: STALL them like an unknown request
+uint8_t USB_VendorSetup(void) {
+    return USB_VENDOR_STALL;
+}
+
+void USB_VendorOut(uint8_t len) {
+    (void)len;
+}
+
+static void Dev_Enter(Dev *d) {
+    if (cur == d) return;
+    if (cur) {
+#define X(v) memcpy(cur->st.v, (void *)&v, sizeof(v));
+        DEV_STATE(X)
+#undef X
+    }
+#define X(v) memcpy((void *)&v, d->st.v, sizeof(v));
+    DEV_STATE(X)
+#undef X
+    cur = d;
+    usb_regs = &d->regs;
+}
+
+static void Dev_Init(Dev *d, uint8_t index) {
+    d->index = index;
+    d->st = pristine;
+    d->regs.uep0_ctrl = UEP_R_RES_ACK | UEP_T_RES_NAK;
+    d->regs.uep1_ctrl = UEP_R_RES_ACK | UEP_T_RES_NAK | RB_UEP_AUTO_TOG;
+    Dev_Enter(d);
+    USB_InitSerial();
+    d->hs = H_ATTACH;
+    d->wait_until = ATTACH_DEBOUNCE_NS;
+    d->enum_start = 0;
+}
+
+/**
+ * Main loop side of the firmware: hand queued reports to EP1
+ */
+static void Dev_Flush(Dev *d) {
+    uint8_t tail;
+
+    Dev_Enter(d);
+    tail = hid_q.tail;
+    if (Hid_Flush(&hid_q, &usb_hid_transport)) {
+        d->ep1_ns = d->push_ns[tail];
+        d->ep1_busy = 1;
+    }
+}
+
+static DevIsrState isr_snap;
+static UsbRegs isr_regs;
+static uint32_t isr_restore_ps;
+
+static void Isr_Save(Dev *d) {
+#define X(v) memcpy(isr_snap.v, (void *)&v, sizeof(v));
+    DEV_ISR_STATE(X)
+#undef X
+    memcpy(isr_snap.ep0, EP0_Databuf, ISR_EP0_BYTES);
+    isr_regs = d->regs;
+}
+
+static inline void Isr_Restore(Dev *d) {
+#define X(v) memcpy((void *)&v, isr_snap.v, sizeof(v));
+    DEV_ISR_STATE(X)
+#undef X
+    memcpy(EP0_Databuf, isr_snap.ep0, ISR_EP0_BYTES);
+    d->regs = isr_regs;
+}
+
+/**
+ * Host CPU time of one USB_DevTransProcess() on the current device, in ps,
+ * including the restore of DEV_ISR_STATE before it. A single handler run is
+ * shorter than a clock_gettime() call, so it is run ISR_BATCH times, each from
+ * the same saved state, and the fastest of ISR_REPEAT batches counts. The caller
+ * runs the handler for real afterwards, from the state as it was on entry.
+ */
+static uint32_t Isr_TimePs(Dev *d) {
+    uint64_t t0, best = UINT64_MAX;
+
+    Isr_Save(d);
+    for (uint32_t r = 0; r < ISR_REPEAT; r++) {
+        t0 = Bench_Ns();
+        for (uint32_t i = 0; i < ISR_BATCH; i++) {
+            Isr_Restore(d);
+            USB_DevTransProcess();
+        }
+        t0 = Bench_Ns() - t0;
+        if (t0 < best) best = t0;
+    }
+    Isr_Restore(d);
+    return (uint32_t)(best * 1000 / ISR_BATCH);
+}
+
+/**
+ * The restore alone, timed once up front the same way over many more batches
+ * (printed as isr_restore_ps). Reported next to the isr figures, not taken off
+ * them: the two overlap in the pipeline, so a difference per sample is noise.
+ */
+static void Isr_Calibrate(Dev *d) {
+    uint64_t t0, best = UINT64_MAX;
+
+    Dev_Enter(d);
+    Isr_Save(d);
+    for (uint32_t r = 0; r < ISR_CALIBRATE; r++) {
+        t0 = Bench_Ns();
+        for (uint32_t i = 0; i < ISR_BATCH; i++) {
+            Isr_Restore(d);
+            __asm__ volatile("" ::: "memory"); // Keep every restore, as with the handler
+        }
+        t0 = Bench_Ns() - t0;
+        if (t0 < best) best = t0;
+    }
+    isr_restore_ps = (uint32_t)(best * 1000 / ISR_BATCH);
+}
+
+/**
+ * Run the pending interrupt if it is due
+ */
+static void Dev_Service(Dev *d, uint64_t now) {
+    uint8_t ep1;
+    uint32_t ps;
+
+    if (d->isr_at == 0 || d->isr_at > now) return;
+    Dev_Enter(d);
+    ep1 = (R8_USB_INT_FG & RB_UIF_TRANSFER) && !(R8_USB_INT_ST & RB_UIS_SETUP_ACT)
+        && (R8_USB_INT_ST & MASK_UIS_ENDP) == 1;
+    ps = Isr_TimePs(d);
+    USB_DevTransProcess();
+    R8_USB_INT_FG = 0;          // Write-one-to-clear on the chip
+    d->isr_at = 0;
+    if (ep1) {
+        Samples_Add(&s_ep1_ps, ps);
+    } else {
+        Samples_Add(&s_ep0_ps, ps);
+        d->enum_isr++;
+    }
+    Dev_Flush(d);
+}
+
+static void Dev_Raise(Dev *d, uint64_t now, uint32_t jitter_ns) {
+    d->isr_at = now + ISR_ENTRY_NS + (jitter_ns ? Rand() % jitter_ns : 0);
+}
+
+// ====================================================================
+// === SIE: how the USB peripheral answers a token ===
+// ====================================================================
+
+static uint32_t isr_jitter_ns;
+
+static TxResult Sie_Setup(Dev *d, uint64_t now, uint8_t addr, const USB_SETUP_REQ *req) {
+    // A SETUP cannot be NAKed; an interrupt still pending is taken first
+    if (d->isr_at) Dev_Service(d, d->isr_at);
+    Dev_Enter(d);
+    if (addr != (R8_USB_DEV_AD & 0x7F)) return TX_TIMEOUT;
+    memcpy(pEP0_RAM_Addr, req, 8);
+    R8_USB_RX_LEN = 8;
+    R8_USB_INT_ST = UIS_TOKEN_SETUP | RB_UIS_SETUP_ACT;
+    R8_USB_INT_FG |= RB_UIF_TRANSFER;
+    Dev_Raise(d, now, isr_jitter_ns);
+    return TX_ACK;
+}
+
+static TxResult Sie_In(Dev *d, uint64_t now, uint8_t addr, uint8_t ep, uint8_t *buf, uint8_t *len) {
+    uint8_t ctrl;
+
+    Dev_Service(d, now);
+    Dev_Enter(d);
+    if (addr != (R8_USB_DEV_AD & 0x7F)) return TX_TIMEOUT;
+    if (d->isr_at) return TX_NAK;       // Interrupt flag still set: SIE NAKs
+    ctrl = ep ? R8_UEP1_CTRL : R8_UEP0_CTRL;
+    if ((ctrl & MASK_UEP_T_RES) == UEP_T_RES_STALL) return TX_STALL;
+    if ((ctrl & MASK_UEP_T_RES) != UEP_T_RES_ACK) return TX_NAK;
+    *len = ep ? R8_UEP1_T_LEN : R8_UEP0_T_LEN;
+    memcpy(buf, ep ? pEP1_RAM_Addr + 64 : pEP0_RAM_Addr, *len);
+    R8_USB_INT_ST = UIS_TOKEN_IN | ep | RB_UIS_TOG_OK;
+    R8_USB_INT_FG |= RB_UIF_TRANSFER;
+    Dev_Raise(d, now, isr_jitter_ns);
+    return TX_ACK;
+}
+
+static TxResult Sie_Out(Dev *d, uint64_t now, uint8_t addr, const uint8_t *buf, uint8_t len) {
+    Dev_Service(d, now);
+    Dev_Enter(d);
+    if (addr != (R8_USB_DEV_AD & 0x7F)) return TX_TIMEOUT;
+    if (d->isr_at) return TX_NAK;
+    if ((R8_UEP0_CTRL & MASK_UEP_R_RES) == UEP_R_RES_STALL) return TX_STALL;
+    if ((R8_UEP0_CTRL & MASK_UEP_R_RES) != UEP_R_RES_ACK) return TX_NAK;
+    memcpy(pEP0_RAM_Addr, buf, len);
+    R8_USB_RX_LEN = len;
+    R8_USB_INT_ST = UIS_TOKEN_OUT | 0 | RB_UIS_TOG_OK;
+    R8_USB_INT_FG |= RB_UIF_TRANSFER;
+    Dev_Raise(d, now, isr_jitter_ns);
+    return TX_ACK;
+}
+
+static void Sie_BusReset(Dev *d, uint64_t now) {
+    Dev_Service(d, now);
+    Dev_Enter(d);
+    if (d->ep1_busy) n_reports_lost++;  // The bus reset handler re-arms EP1 with NAK
+    d->ep1_busy = 0;
+    R8_USB_INT_FG |= RB_UIF_BUS_RST;
+    d->isr_at = now + PORT_RESET_NS;    // Seen when the reset ends
+    n_resets++;
+}
+
+// ====================================================================
+// === SCRIPTED HOST ===
+// ====================================================================
+
+typedef struct {
+    uint8_t reset;              // Port reset instead of a request
+    uint8_t bRequestType, bRequest;
+    uint16_t wValue, wIndex, wLength;
+} Step;
+
+#define STEP_REQ(t, r, v, i, l) { 0, t, r, v, i, l }
+#define STEP_RESET { 1, 0, 0, 0, 0, 0 }
+
+static const Step script[] = {
+    STEP_RESET,
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0100, 0, 64),
+    STEP_RESET,
+    STEP_REQ(0x00, USB_SET_ADDRESS, 0, 0, 0),
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0100, 0, 18),
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0200, 0, 9),
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0200, 0, 255),
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0300, 0, 255),
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0302, 0x0409, 255),
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0301, 0x0409, 255),
+    STEP_REQ(0x80, USB_GET_DESCRIPTOR, 0x0303, 0x0409, 255),
+    STEP_REQ(0x00, USB_SET_CONFIGURATION, 1, 0, 0),
+    STEP_REQ(0x21, HID_SET_IDLE, 0, 0, 0),
+    STEP_REQ(0x81, USB_GET_DESCRIPTOR, 0x2200, 0, sizeof(MyHIDReportDescr) + 64),
+    STEP_REQ(0x21, HID_SET_REPORT, 0x0200, 0, 1),
+};
+#define SCRIPT_LEN (sizeof(script) / sizeof(script[0]))
+
+static uint8_t addr0_owner;     // 1 + index of the device being enumerated at address 0, 0 = free
+static uint8_t poll_interval;   // Frames, from the endpoint descriptor
+
+static void Host_Restart(Dev *d, uint64_t now) {
+    d->hs = H_LOCK;
+    d->addr = 0;
+    d->step = 0;
+    d->enum_start = now;
+    d->enum_isr = 0;
+}
+
+static void Host_StepDone(Dev *d, uint64_t now, TxResult r) {
+    const Step *s = &script[d->step];
+
+    if (r == TX_TIMEOUT || (r == TX_STALL && (s->bRequest == USB_SET_ADDRESS || s->bRequest == USB_SET_CONFIGURATION))) {
+        n_enum_fail++;
+        Host_Restart(d, now);
+        return;
+    }
+    d->wait_until = now;
+    if (s->bRequest == USB_SET_ADDRESS) {
+        d->addr = d->index + 1;
+        if (addr0_owner == d->index + 1) addr0_owner = 0;
+        d->wait_until = now + SET_ADDRESS_RECOVERY_NS;
+    }
+    d->step++;
+    d->hs = H_STEP;
+}
+
+static void Host_Step(Dev *d, uint64_t now) {
+    const Step *s;
+
+    if (now < d->wait_until) return;
+    if (d->step == SCRIPT_LEN) {
+        d->hs = H_READY;
+        Samples_Add(&s_enum_ms, (uint32_t)((now - d->enum_start) / 1000000u));
+        Samples_Add(&s_isr_per_enum, d->enum_isr);
+        d->ever_ready = 1;
+        return;
+    }
+    s = &script[d->step];
+    if (s->reset) {
+        Sie_BusReset(d, now);
+        d->addr = 0;
+        d->wait_until = now + PORT_RESET_NS + RESET_RECOVERY_NS;
+        d->step++;
+        return;
+    }
+    d->setup.bRequestType = s->bRequestType;
+    d->setup.bRequest = s->bRequest;
+    d->setup.wValue = (s->bRequest == USB_SET_ADDRESS) ? d->index + 1 : s->wValue;
+    d->setup.wIndex = s->wIndex;
+    d->setup.wLength = s->wLength;
+    d->out_data[0] = 0;
+    d->stage = CT_SETUP;
+    d->got = 0;
+    d->retries = 0;
+    d->ctrl_start = now;
+    d->hs = H_CTRL;
+}
+
+/**
+ * One transaction of the control transfer in progress. Returns the bus bytes used.
+ */
+static uint32_t Host_CtrlTx(Dev *d, uint64_t now) {
+    uint8_t buf[64], len = 0;
+    uint32_t bytes = NAK_BYTES;
+    uint8_t done = 0;
+    TxResult r;
+    uint8_t in = d->setup.bRequestType & USB_REQ_TYP_IN;
+
+    switch (d->stage) {
+    case CT_SETUP:
+        r = Sie_Setup(d, now, d->addr, &d->setup);
+        bytes = 8 + TX_OVERHEAD;
+        if (r == TX_ACK) d->stage = in ? CT_DATA_IN : d->setup.wLength ? CT_DATA_OUT : CT_STATUS_IN;
+        break;
+    case CT_DATA_IN:
+        r = Sie_In(d, now, d->addr, 0, buf, &len);
+        if (r == TX_ACK) {
+            bytes = len + TX_OVERHEAD;
+            d->got += len;
+            if (len < DevEP0SIZE || d->got >= d->setup.wLength) d->stage = CT_STATUS_OUT;
+        }
+        break;
+    case CT_DATA_OUT:
+        r = Sie_Out(d, now, d->addr, d->out_data, d->setup.wLength);
+        if (r == TX_ACK) {
+            bytes = d->setup.wLength + TX_OVERHEAD;
+            d->stage = CT_STATUS_IN;
+        }
+        break;
+    case CT_STATUS_IN:
+        r = Sie_In(d, now, d->addr, 0, buf, &len);
+        if (r == TX_ACK) bytes = TX_OVERHEAD, done = 1;
+        break;
+    case CT_STATUS_OUT:
+    default:
+        r = Sie_Out(d, now, d->addr, NULL, 0);
+        if (r == TX_ACK) bytes = TX_OVERHEAD, done = 1;
+        break;
+    }
+
+    n_tx++;
+    if (r == TX_NAK) n_nak++;
+    if (r == TX_STALL) n_stall++;
+    if (r == TX_TIMEOUT) {
+        n_timeout++;
+        bytes = TIMEOUT_BYTES;
+        if (++d->retries > CTRL_RETRIES) Host_StepDone(d, now, TX_TIMEOUT);
+    } else if (r == TX_STALL) {
+        Host_StepDone(d, now, TX_STALL);
+    } else if (done) {
+        Host_StepDone(d, now, TX_ACK);
+    } else if (now - d->ctrl_start > CTRL_TIMEOUT_NS) {
+        Host_StepDone(d, now, TX_TIMEOUT);
+    }
+    return bytes;
+}
+
+/**
+ * Interrupt IN poll of EP1. Returns the bus bytes used.
+ */
+static uint32_t Host_Poll(Dev *d, uint64_t now) {
+    uint8_t buf[64], len;
+    TxResult r = Sie_In(d, now, d->addr, 1, buf, &len);
+
+    n_tx++;
+    if (r == TX_NAK) n_nak++;
+    if (r == TX_STALL) n_stall++;
+    if (r == TX_TIMEOUT) {
+        n_timeout++;
+        return TIMEOUT_BYTES;
+    }
+    if (r != TX_ACK) return NAK_BYTES;
+    if (d->ep1_busy) {
+        Samples_Add(&s_report_us, (uint32_t)((now - d->ep1_ns) / 1000u));
+        d->ep1_busy = 0;
+    }
+    return len + TX_OVERHEAD;
+}
+
+/**
+ * Firmware side key event: queue a press or release report
+ */
+static void Dev_KeyEvent(Dev *d, uint64_t now) {
+    uint8_t report[HID_REPORT_MAX], len, code = 0x04;
+    uint8_t head;
+
+    Dev_Enter(d);
+    d->key_down ^= 1;
+    len = Report_PackKeys(report, UsbProtocol == 0, 0, &code, d->key_down);
+    head = hid_q.head;
+    if (HidQueue_Push(&hid_q, HID_CH_KEYBOARD, report, len)) d->push_ns[head] = now;
+    Dev_Flush(d);
+}
+
+// ====================================================================
+// === MAIN ===
+// ====================================================================
+
+int main(int argc, char **argv) {
+    uint32_t n_dev = 32, key_ms = 50;
+    double seconds = 10, reset_rate = 0.05, storm_pct = 0;
+    uint32_t jitter_us = 50, rr = 0;
+    uint64_t frames, f;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        switch (argv[i][1]) {
+        case 'n': n_dev = atoi(argv[i + 1]); break;
+        case 't': seconds = atof(argv[i + 1]); break;
+        case 'r': reset_rate = atof(argv[i + 1]); break;
+        case 's': storm_pct = atof(argv[i + 1]); break;
+        case 'j': jitter_us = atoi(argv[i + 1]); break;
+        case 'k': key_ms = atoi(argv[i + 1]); break;
+        case 'S': rng = atoi(argv[i + 1]) | 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n devices] [-t seconds] [-r resets] [-s storm] [-j jitter] [-k key_ms] [-S seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n_dev < 1 || n_dev > MAX_DEVICES || key_ms < 1) {
+        fprintf(stderr, "devices must be 1..%d, key_ms >= 1\n", MAX_DEVICES);
+        return 1;
+    }
+    isr_jitter_ns = jitter_us * 1000u;
+    poll_interval = MyCfgDescr[sizeof(MyCfgDescr) - 1];
+
+    pEP0_RAM_Addr = EP0_Databuf;
+    pEP1_RAM_Addr = EP1_Databuf;
+#define X(v) memcpy(pristine.v, (void *)&v, sizeof(v));
+    DEV_STATE(X)
+#undef X
+    for (uint32_t i = 0; i < n_dev; i++) Dev_Init(&devs[i], i);
+    Isr_Calibrate(&devs[0]);
+
+    printf("usb_hub_bench devices=%u seconds=%.1f resets=%.3f storm=%.0f jitter_us=%u key_ms=%u poll_ms=%u\n",
+        n_dev, seconds, reset_rate, storm_pct, jitter_us, key_ms, poll_interval);
+
+    frames = (uint64_t)(seconds * 1000);
+    for (f = 0; f < frames; f++) {
+        uint64_t start = f * FRAME_NS, now = start + 5 * NS_PER_BYTE; // After SOF
+        uint32_t budget = FRAME_USABLE, used, storm;
+        uint8_t progress;
+
+        // Frame start: pending interrupts, key events, host state machines
+        for (uint32_t i = 0; i < n_dev; i++) {
+            Dev *d = &devs[i];
+
+            Dev_Service(d, start);
+            if (d->hs == H_READY && Rand() % key_ms == 0) Dev_KeyEvent(d, start);
+            if (d->hs != H_ATTACH && d->hs != H_LOCK
+                && (Rand() & 0xFFFFFF) < reset_rate * (FRAME_NS / 1e9) * 0x1000000) {
+                Host_Restart(d, start);
+            }
+            if (d->hs == H_ATTACH && start >= d->wait_until) Host_Restart(d, start);
+            if (d->hs == H_LOCK && (addr0_owner == 0 || addr0_owner == i + 1)) {
+                addr0_owner = i + 1;
+                d->hs = H_STEP;
+                d->wait_until = start;
+            }
+            if (d->hs == H_STEP) Host_Step(d, start);
+        }
+        if (!all_ready_ns) {
+            uint32_t i;
+            for (i = 0; i < n_dev && devs[i].ever_ready; i++) ;
+            if (i == n_dev) all_ready_ns = start;
+        }
+
+        // Periodic schedule
+        for (uint32_t i = 0; i < n_dev; i++) {
+            Dev *d = &devs[i];
+            if (d->hs != H_READY || (f + i) % poll_interval) continue;
+            used = Host_Poll(d, now);
+            now += used * NS_PER_BYTE;
+            budget -= used < budget ? used : budget;
+        }
+
+        // NAK storm from a misbehaving device elsewhere on the hub
+        storm = (uint32_t)(FRAME_USABLE * storm_pct / 100);
+        if (storm > budget) storm = budget;
+        n_storm_nak += storm / NAK_BYTES;
+        budget -= storm;
+        now += storm * NS_PER_BYTE;
+
+        // Control transfers, round-robin, retried until the frame is full
+        do {
+            progress = 0;
+            for (uint32_t k = 0; k < n_dev && budget >= 64 + TX_OVERHEAD; k++) {
+                Dev *d = &devs[(rr + k) % n_dev];
+                if (d->hs == H_STEP) Host_Step(d, now);
+                if (d->hs != H_CTRL) continue;
+                used = Host_CtrlTx(d, now);
+                now += used * NS_PER_BYTE;
+                budget -= used < budget ? used : budget;
+                progress = 1;
+            }
+        } while (progress && budget >= 64 + TX_OVERHEAD);
+        rr = (rr + 1) % n_dev;
+        bus_bytes += FRAME_USABLE - budget;
+    }
+
+    Samples_Print("enum_ms", &s_enum_ms, "ms");
+    printf("all_ready_ms %llu\n", all_ready_ns ? (unsigned long long)(all_ready_ns / 1000000u) : 0ull);
+    Samples_Print("ep0_isr_ps", &s_ep0_ps, "ps");
+    Samples_Print("ep1_isr_ps", &s_ep1_ps, "ps");
+    printf("isr_restore_ps %u\n", isr_restore_ps);
+    Samples_Print("ep0_isr_per_enum", &s_isr_per_enum, "irq");
+    Samples_Print("report_us", &s_report_us, "us");
+    printf("bus busy_pct=%.1f tx=%llu nak=%llu stall=%llu timeout=%llu storm_nak=%llu\n",
+        100.0 * bus_bytes / ((double)frames * FRAME_USABLE),
+        (unsigned long long)n_tx, (unsigned long long)n_nak, (unsigned long long)n_stall,
+        (unsigned long long)n_timeout, (unsigned long long)n_storm_nak);
+    printf("events port_resets=%llu enum_fail=%llu reports_lost=%llu\n",
+        (unsigned long long)n_resets, (unsigned long long)n_enum_fail, (unsigned long long)n_reports_lost);
+    return 0;
+}
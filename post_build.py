@@ -19,4 +19,56 @@ env.AddPostAction(
         raw_command,
         f"Converting to firmware.bin | `{expanded_command}`"  # Fixed the message to match the output file
     )
-)
\ No newline at end of file
+)
+
+# Size report: section totals and per-symbol sizes of firmware.elf, saved as
+# size_report.json next to it. Differences to the previous build (or to the
+# report named by the SIZE_BASELINE environment variable, e.g. one kept from
+# the main branch) are printed as "size ..." lines.
+import json
+import os
+import subprocess
+
+
+def size_report(target, source, env):
+    build_dir = env.subst("$BUILD_DIR")
+    elf = os.path.join(build_dir, "firmware.elf")
+    report_path = os.path.join(build_dir, "size_report.json")
+    objcopy = env.subst("$OBJCOPY")
+    size_tool = env.subst("$SIZETOOL") or objcopy.replace("objcopy", "size")
+    nm_tool = objcopy.replace("objcopy", "nm")
+
+    # Berkeley format: text data bss dec hex filename
+    totals = subprocess.check_output([size_tool, "-B", elf], text=True).splitlines()[1].split()
+    report = {"text": int(totals[0]), "data": int(totals[1]), "bss": int(totals[2]), "symbols": {}}
+    for line in subprocess.check_output([nm_tool, "-S", "--size-sort", "-t", "d", elf], text=True).splitlines():
+        parts = line.split()
+        if len(parts) == 4:
+            report["symbols"][parts[3]] = report["symbols"].get(parts[3], 0) + int(parts[1])
+
+    baseline_path = os.environ.get("SIZE_BASELINE", report_path)
+    baseline = None
+    if os.path.isfile(baseline_path):
+        with open(baseline_path) as f:
+            baseline = json.load(f)
+
+    def delta(new, old):
+        return "" if old is None else " (%+d)" % (new - old)
+
+    print("size text=%d%s data=%d%s bss=%d%s" % (
+        report["text"], delta(report["text"], baseline and baseline["text"]),
+        report["data"], delta(report["data"], baseline and baseline["data"]),
+        report["bss"], delta(report["bss"], baseline and baseline["bss"])))
+    if baseline:
+        old_syms = baseline["symbols"]
+        changed = [(name, report["symbols"].get(name, 0), old_syms.get(name, 0))
+                   for name in set(report["symbols"]) | set(old_syms)
+                   if report["symbols"].get(name, 0) != old_syms.get(name, 0)]
+        for name, new, old in sorted(changed, key=lambda c: -abs(c[1] - c[2]))[:20]:
+            print("size sym %s %d (%+d)" % (name, new, new - old))
+
+    with open(report_path, "w") as f:
+        json.dump(report, f, indent=1, sort_keys=True)
+
+
+env.AddPostAction("$BUILD_DIR/firmware.elf", size_report)
@@ -0,0 +1,190 @@
+#ifndef BLE_HID_H
+#define BLE_HID_H
+
+// --- BLE HID-over-GATT transport (build with -DCONFIG_BLE_HID) ---
+//
+// Drives the same HidQueue as the USB path through the WCH HID device profile.
+// Needs the WCH BLE library (CH58xBLE_LIB), the HAL (HAL/MCU.c, RTC.c, SLEEP.c)
+// and the HOG profile sources (hiddev.c, hidkbdservice.c) from the SDK's
+// HID_Keyboard example in the build.
+//
+// BleHid_Init() brings up the stack, GAP peripheral role, bond manager and HID
+// service and starts advertising. The main loop calls BleHid_Process() on every
+// wakeup to run the TMOS scheduler; the radio and TMOS timer interrupts wake the
+// __WFI() in time. BleHid_StateCB() (the profile's GAP role state callback)
+// keeps ble_hid_connected in step with the link, and asks for the connection
+// parameters below a second after the link comes up. HidDev_Report() holds
+// reports back itself until the host has enabled notifications.
+
+#ifdef CONFIG_BLE_HID
+
+#include "CH58xBLE_LIB.h"
+#include "HAL.h"
+#include "hiddev.h"
+#include "hidkbdservice.h"
+#include "hid_report.h"
+
+#ifdef HID_REPORT_IDS
+#error "The HOG profile report map is the SDK boot keyboard; build BLE without CONFIG_HID_NKRO/CONFIG_HID_CONSUMER"
+#endif
+
+// Short connection interval for low latency (units of 1.25 ms => 7.5 ms)
+#define BLE_HID_MIN_CONN_INTERVAL 6
+#define BLE_HID_MAX_CONN_INTERVAL 6
+#define BLE_HID_SLAVE_LATENCY 0
+#define BLE_HID_CONN_TIMEOUT 500        // Supervision timeout, units of 10 ms
+
+// Notifications queued to the stack per flush. Everything queued before the
+// next connection event goes out in that event, so a burst of key changes
+// costs one interval instead of one interval per report.
+#define BLE_HID_REPORTS_PER_EVENT 4
+
+#define BLE_HID_IDLE_TIMEOUT 60000      // Drop the link after this long without reports (ms)
+#define BLE_HID_PARAM_UPDATE_DELAY 1600 // Wait before asking for BLE_HID_*_CONN_* (units of 625 us => 1 s)
+
+// TMOS task events
+#define BLE_HID_START_EVT        0x0001
+#define BLE_HID_PARAM_UPDATE_EVT 0x0002
+
+volatile uint8_t ble_hid_connected;
+uint8_t  BleHid_TaskId = INVALID_TASK_ID;
+uint16_t BleHid_ConnHandle = GAP_CONNHANDLE_INIT;
+
+const uint8_t BleHid_Name[] = "BLE Keybd";
+
+uint8_t BleHid_AdvData[] = {
+    0x02, GAP_ADTYPE_FLAGS, GAP_ADTYPE_FLAGS_LIMITED | GAP_ADTYPE_FLAGS_BREDR_NOT_SUPPORTED,
+    0x03, GAP_ADTYPE_APPEARANCE, LO_UINT16(GAP_APPEARE_HID_KEYBOARD), HI_UINT16(GAP_APPEARE_HID_KEYBOARD),
+    0x03, GAP_ADTYPE_16BIT_MORE, LO_UINT16(HID_SERV_UUID), HI_UINT16(HID_SERV_UUID)
+};
+
+uint8_t BleHid_ScanRsp[] = {
+    0x0A, GAP_ADTYPE_LOCAL_NAME_COMPLETE, 'B', 'L', 'E', ' ', 'K', 'e', 'y', 'b', 'd'
+};
+
+hidDevCfg_t BleHid_Cfg = { BLE_HID_IDLE_TIMEOUT, HID_KBD_FLAGS };
+
+/**
+ * GAP role state callback: track the link and request the connection parameters
+ */
+void BleHid_StateCB(gapRole_States_t state, gapRoleEvent_t *ev) {
+    switch (state & GAPROLE_STATE_ADV_MASK) {
+        case GAPROLE_CONNECTED:
+            if (ev->gap.opcode == GAP_LINK_ESTABLISHED_EVENT) {
+                BleHid_ConnHandle = ev->linkCmpl.connectionHandle;
+                ble_hid_connected = 1;
+                tmos_start_task(BleHid_TaskId, BLE_HID_PARAM_UPDATE_EVT, BLE_HID_PARAM_UPDATE_DELAY);
+            }
+            break;
+        case GAPROLE_WAITING:
+        case GAPROLE_ADVERTISING:
+            // Link gone (terminated, timed out); hiddev.c re-advertises on its own
+            if (BleHid_ConnHandle != GAP_CONNHANDLE_INIT) {
+                BleHid_ConnHandle = GAP_CONNHANDLE_INIT;
+                ble_hid_connected = 0;
+                tmos_stop_task(BleHid_TaskId, BLE_HID_PARAM_UPDATE_EVT);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * HID service reads/writes (protocol mode, LED output report, CCCs)
+ */
+uint8_t BleHid_ReportCB(uint8_t id, uint8_t type, uint16_t uuid, uint8_t oper, uint16_t *len, uint8_t *data) {
+    uint8_t n;
+    uint8_t status = SUCCESS;
+
+    if (oper == HID_DEV_OPER_WRITE) {
+        status = Hid_SetParameter(id, type, uuid, *len, data);
+    } else if (oper == HID_DEV_OPER_READ) {
+        status = Hid_GetParameter(id, type, uuid, &n, data);
+        if (status == SUCCESS) *len = n;
+    }
+    return status;
+}
+
+void BleHid_EventCB(uint8_t evt) {
+    (void)evt; // Suspend/exit suspend/boot mode: the report layout is the same
+}
+
+hidDevCB_t BleHid_CBs = { BleHid_ReportCB, BleHid_EventCB, NULL, BleHid_StateCB };
+
+/**
+ * TMOS task: start-up and the deferred connection parameter update
+ */
+uint16_t BleHid_ProcessEvent(uint8_t task_id, uint16_t events) {
+    if (events & SYS_EVENT_MSG) {
+        uint8_t *msg = tmos_msg_receive(task_id);
+        if (msg) tmos_msg_deallocate(msg);
+        return events ^ SYS_EVENT_MSG;
+    }
+    if (events & BLE_HID_START_EVT) {
+        return events ^ BLE_HID_START_EVT;
+    }
+    if (events & BLE_HID_PARAM_UPDATE_EVT) {
+        GAPRole_PeripheralConnParamUpdateReq(BleHid_ConnHandle,
+            BLE_HID_MIN_CONN_INTERVAL, BLE_HID_MAX_CONN_INTERVAL,
+            BLE_HID_SLAVE_LATENCY, BLE_HID_CONN_TIMEOUT, BleHid_TaskId);
+        return events ^ BLE_HID_PARAM_UPDATE_EVT;
+    }
+    return 0;
+}
+
+/**
+ * Bring up the BLE stack and the HOG profile, start advertising
+ */
+void BleHid_Init(void) {
+    uint8_t adv_on = TRUE;
+    uint8_t pair_mode = GAPBOND_PAIRING_MODE_WAIT_FOR_REQ;
+    uint8_t mitm = FALSE;
+    uint8_t io_cap = GAPBOND_IO_CAP_NO_INPUT_NO_OUTPUT;
+    uint8_t bonding = TRUE;
+
+    CH58X_BLEInit();
+    HAL_Init();
+    GAPRole_PeripheralInit();
+    HidDev_Init();
+
+    BleHid_TaskId = TMOS_ProcessEventRegister(BleHid_ProcessEvent);
+
+    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(adv_on), &adv_on);
+    GAPRole_SetParameter(GAPROLE_ADVERT_DATA, sizeof(BleHid_AdvData), BleHid_AdvData);
+    GAPRole_SetParameter(GAPROLE_SCAN_RSP_DATA, sizeof(BleHid_ScanRsp), BleHid_ScanRsp);
+    GGS_SetParameter(GGS_DEVICE_NAME_ATT, sizeof(BleHid_Name) - 1, (void *)BleHid_Name);
+
+    GAPBondMgr_SetParameter(GAPBOND_PERI_PAIRING_MODE, sizeof(pair_mode), &pair_mode);
+    GAPBondMgr_SetParameter(GAPBOND_PERI_MITM_PROTECTION, sizeof(mitm), &mitm);
+    GAPBondMgr_SetParameter(GAPBOND_PERI_IO_CAPABILITIES, sizeof(io_cap), &io_cap);
+    GAPBondMgr_SetParameter(GAPBOND_PERI_BONDING_ENABLED, sizeof(bonding), &bonding);
+
+    Hid_AddService();
+    HidDev_Register(&BleHid_Cfg, &BleHid_CBs);
+    tmos_set_event(BleHid_TaskId, BLE_HID_START_EVT);
+}
+
+/**
+ * Run the BLE stack (TMOS), once per main loop wakeup
+ */
+void BleHid_Process(void) {
+    TMOS_SystemProcess();
+}
+
+uint8_t BleHid_Ready(void) {
+    return ble_hid_connected;
+}
+
+void BleHid_Send(uint8_t ch, const uint8_t *buf, uint8_t len) {
+    (void)ch; // Keyboard only, see the HID_REPORT_IDS check above
+    HidDev_Report(HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT, len, (uint8_t *)buf);
+}
+
+const HidTransport ble_hid_transport = {
+    "ble", BleHid_Ready, BleHid_Send, BLE_HID_REPORTS_PER_EVENT
+};
+
+#endif // CONFIG_BLE_HID
+
+#endif
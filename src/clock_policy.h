@@ -0,0 +1,113 @@
+#ifndef CLOCK_POLICY_H
+#define CLOCK_POLICY_H
+
+#include <stdint.h>
+
+// --- Activity-driven system clock policy ---
+//
+// Two levels: the full PLL clock while there is work (USB traffic, something
+// near the panel, reports queued, firmware update) and a low clock once nothing
+// has happened for CLOCK_IDLE_HOLD_MS, and always while the bus is suspended.
+// USB traffic at the low clock boosts right away, without waiting for the next
+// sweep. main.c does the actual switch (Clock_Apply).
+//
+// NOTE: TMR0 and UART1 run from the system clock, so every switch re-derives
+// the scan timer (restarting the current period) and the baud rate. That is why
+// the clock follows activity with a hold time instead of dropping around every
+// __WFI(): the core is clock-gated while it waits anyway.
+//
+// Time at each level is accounted on the scan clock (microseconds of sweep
+// timestamps), the console shows it with "clk". Anything that busy-waits while
+// the clock may be low has to scale by GetSysClock() (USB_RemoteWakeup).
+
+#define CLOCK_IDLE_HOLD_MS 500      // No activity for this long: drop to the low clock
+
+typedef enum {
+    CLOCK_LOW = 0,
+    CLOCK_HIGH,
+    CLOCK_LEVELS
+} ClockLevel;
+
+typedef enum {
+    CLOCK_AUTO = 0,
+    CLOCK_FORCE_LOW,
+    CLOCK_FORCE_HIGH
+} ClockMode;
+
+typedef struct {
+    uint8_t  level;             // ClockLevel running now
+    uint8_t  mode;              // ClockMode (console)
+    uint8_t  mhz[CLOCK_LEVELS]; // System clock per level, recorded when it is first used
+    volatile uint8_t usb_irq;   // USB interrupt since the last ClockPolicy_Update()
+    uint32_t idle_us;           // Time without activity
+    uint32_t last_us;           // Scan clock time accounted up to
+    uint64_t time_us[CLOCK_LEVELS];
+    uint32_t switches;
+} ClockPolicy;
+
+ClockPolicy clock_pol;
+
+/**
+ * Start accounting at the boot clock: not a switch, no time charged to another level
+ */
+void ClockPolicy_Init(ClockPolicy *cp, uint8_t level, uint8_t mhz, uint32_t now_us) {
+    cp->level = level;
+    cp->mhz[level] = mhz;
+    cp->last_us = now_us;
+}
+
+/**
+ * Add the time since the last call to the running level
+ */
+void ClockPolicy_Account(ClockPolicy *cp, uint32_t now_us) {
+    cp->time_us[cp->level] += now_us - cp->last_us;
+    cp->last_us = now_us;
+}
+
+/**
+ * Once per sweep: account the time and pick the level for what follows.
+ * busy = work in hand this sweep, frame_us = scan period.
+ */
+uint8_t ClockPolicy_Update(ClockPolicy *cp, uint32_t now_us, uint32_t frame_us, uint8_t busy, uint8_t suspended) {
+    ClockPolicy_Account(cp, now_us);
+    if (busy || cp->usb_irq) {
+        cp->idle_us = 0;
+        cp->usb_irq = 0;
+    } else if (cp->idle_us < CLOCK_IDLE_HOLD_MS * 1000u) {
+        cp->idle_us += frame_us;
+    }
+
+    if (suspended || cp->mode == CLOCK_FORCE_LOW) return CLOCK_LOW;
+    if (cp->mode == CLOCK_FORCE_HIGH) return CLOCK_HIGH;
+    return (cp->idle_us >= CLOCK_IDLE_HOLD_MS * 1000u) ? CLOCK_LOW : CLOCK_HIGH;
+}
+
+/**
+ * Between sweeps: USB traffic arrived while at the low clock
+ */
+uint8_t ClockPolicy_Boost(const ClockPolicy *cp, uint8_t suspended) {
+    return cp->level == CLOCK_LOW && cp->usb_irq && !suspended && cp->mode == CLOCK_AUTO;
+}
+
+/**
+ * Record a switch to level (running at mhz), at scan clock time now_us
+ */
+void ClockPolicy_Switched(ClockPolicy *cp, uint8_t level, uint8_t mhz, uint32_t now_us) {
+    ClockPolicy_Account(cp, now_us);
+    if (level != cp->level) cp->switches++;
+    cp->level = level;
+    cp->mhz[level] = mhz;
+}
+
+/**
+ * CPU clock cycles spent, in % of running at the high clock all the time
+ */
+uint8_t ClockPolicy_CyclePct(const ClockPolicy *cp) {
+    uint64_t total = cp->time_us[CLOCK_LOW] + cp->time_us[CLOCK_HIGH];
+    uint64_t cycles = cp->time_us[CLOCK_LOW] * cp->mhz[CLOCK_LOW] + cp->time_us[CLOCK_HIGH] * cp->mhz[CLOCK_HIGH];
+
+    if (total == 0 || cp->mhz[CLOCK_HIGH] == 0) return 100;
+    return (uint8_t)(cycles * 100 / (total * cp->mhz[CLOCK_HIGH]));
+}
+
+#endif
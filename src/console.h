@@ -0,0 +1,288 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CH58x_common.h"
+#include "touch.h"
+#include "usb_device.h"
+#include "touch_frame.h"
+#include "scan_clock.h"
+#include "health.h"
+#include "gesture.h"
+#include "clock_policy.h"
+
+// --- Runtime command console on UART1 RX (PA8) ---
+//
+// Line based, 115200 8N1, terminated by CR or LF. Numbers are decimal or 0x-hex.
+//
+//   thr <k> [val]    get/set touch threshold of key k
+//   deb <k> [n]      get/set debounce count of key k (consecutive scans)
+//   key <k> [code]   get/set HID keycode of key k (0x8000 | usage = consumer key,
+//                    needs -DCONFIG_HID_CONSUMER)
+//   rate [hz]        get/set scan rate while active (limited by the measured sweep time)
+//   scan             dump scan clock rate, jitter, sweep time and overruns
+//   cal              re-calibrate all baselines
+//   stats            dump per-key baseline/raw/state/press counters
+//   noise            dump per-key, per-hop noise (mean |deviation| from the median) and outliers
+//   frame            dump frame classifier counters (idle/prox/touch/water/guard)
+//   trace <0|1>      stream per-hop deltas each sweep ("T," lines, for tools/false_trigger.py)
+//                    and touch events ("E,<t_us>,<key>,<down>")
+//   gest [0|1]       get/set gesture mode, dump gesture counters
+//   usb              dump the USB enumeration trace
+//   health           dump channel faults and error counters
+//   clk [auto|low|high]  get/set clock mode, dump time at each clock level
+//
+// NOTE: The UART1 RX interrupt (main.c) moves bytes out of the 8-byte FIFO into
+// a ring buffer as they arrive, so a pasted line survives the 10/20 Hz idle and
+// suspend scan rates. Console_Poll() parses from the ring once per scan and never
+// blocks the scan loop. Commands that touch hardware (cal) are only flagged here
+// and carried out by the main loop between scans.
+
+#define CONSOLE_LINE_MAX 32     // Longest accepted command line
+#define CONSOLE_MAX_ARGS 3      // Command name + 2 arguments
+#define CONSOLE_RX_LEN 128      // RX ring buffer, must be a power of two
+
+typedef struct {
+    char line[CONSOLE_LINE_MAX];
+    uint8_t len;
+    uint8_t overflow;
+
+    // Filled by the UART1 RX interrupt, drained by Console_Poll()
+    char rx[CONSOLE_RX_LEN];
+    volatile uint8_t rx_head;   // Next slot to write (ISR)
+    volatile uint8_t rx_tail;   // Next slot to read (main loop)
+    volatile uint32_t rx_lost;  // Bytes dropped because the ring was full
+    uint32_t rx_lost_seen;
+} ConsoleState;
+
+ConsoleState console;
+
+/**
+ * Parse a decimal or 0x-hex number. Returns 0 on success.
+ */
+int Console_ParseNum(const char *s, uint32_t *out) {
+    char *end;
+    if (s == NULL || *s == '\0') return -1;
+    *out = strtoul(s, &end, 0);
+    return (*end == '\0') ? 0 : -1;
+}
+
+/**
+ * Parse a key index argument. Returns the index or -1 if out of range.
+ */
+int Console_ParseKey(const char *s) {
+    uint32_t k;
+    if (Console_ParseNum(s, &k) || k >= NUM_KEYS) {
+        printf("ERR key\n");
+        return -1;
+    }
+    return (int)k;
+}
+
+void Console_Exec(int argc, char *argv[]) {
+    uint32_t v;
+    int k;
+
+    if (strcmp(argv[0], "thr") == 0 && argc >= 2) {
+        if ((k = Console_ParseKey(argv[1])) < 0) return;
+        if (argc == 3) {
+            if (Console_ParseNum(argv[2], &v) || v == 0 || v > 0x0FFF) { printf("ERR val\n"); return; }
+            touch_cfg.thres[k] = v;
+        }
+        printf("thr %d %u\n", k, touch_cfg.thres[k]);
+    }
+    else if (strcmp(argv[0], "deb") == 0 && argc >= 2) {
+        if ((k = Console_ParseKey(argv[1])) < 0) return;
+        if (argc == 3) {
+            if (Console_ParseNum(argv[2], &v) || v == 0 || v > 0xFF) { printf("ERR val\n"); return; }
+            touch_cfg.debounce[k] = v;
+        }
+        printf("deb %d %u\n", k, touch_cfg.debounce[k]);
+    }
+    else if (strcmp(argv[0], "key") == 0 && argc >= 2) {
+        if ((k = Console_ParseKey(argv[1])) < 0) return;
+        if (argc == 3) {
+            if (Console_ParseNum(argv[2], &v) || v > 0xFFFF ||
+                (!(v & KEYCODE_CONSUMER) && v > KEYBOARD_USAGE_MAX)) { printf("ERR val\n"); return; }
+#ifndef CONFIG_HID_CONSUMER
+            // No consumer report in this build: Hid_ReportKeys() would drop it
+            if (v & KEYCODE_CONSUMER) { printf("ERR consumer\n"); return; }
+#endif
+            touch_cfg.key_map[k] = v;
+        }
+        printf("key %d 0x%04X\n", k, touch_cfg.key_map[k]);
+    }
+    else if (strcmp(argv[0], "rate") == 0) {
+        uint16_t max = ScanClock_MaxHz(&scan_clk);
+        if (argc == 2) {
+            if (Console_ParseNum(argv[1], &v) || v < SCAN_HZ_MIN) { printf("ERR val\n"); return; }
+            // A period shorter than the sweep only produces overruns and starves the main loop
+            if (v > max) { printf("ERR rate max %u\n", max); return; }
+            touch_cfg.scan_hz = v;
+        }
+        printf("rate %u max %u\n", touch_cfg.scan_hz, max);
+    }
+    else if (strcmp(argv[0], "scan") == 0) {
+        uint32_t mhz = scan_clk.clk / 1000000;
+        printf("scan %u Hz period %lu frames %lu overruns %lu\n", scan_clk.hz,
+            (unsigned long)scan_clk.period, (unsigned long)scan_clk.frames, (unsigned long)scan_clk.overruns);
+        if (scan_clk.lat_min != UINT32_MAX && mhz) {
+            printf("latency us min %lu avg %lu max %lu jitter ns %lu sweep max us %lu\n",
+                (unsigned long)(scan_clk.lat_min / mhz),
+                (unsigned long)((scan_clk.lat_avg >> 4) / mhz),
+                (unsigned long)(scan_clk.lat_max / mhz),
+                (unsigned long)ScanClock_JitterNs(&scan_clk),
+                (unsigned long)(scan_clk.sweep_max / mhz));
+        }
+    }
+    else if (strcmp(argv[0], "cal") == 0) {
+        touch_cfg.recal_req = 1;
+        printf("cal pending\n");
+    }
+    else if (strcmp(argv[0], "stats") == 0) {
+        printf("scans %lu\n", (unsigned long)touch_st.scans);
+        for (k = 0; k < NUM_KEYS; k++) {
+            printf("k%d ch%d base %u raw %u diff %d state %u presses %lu\n",
+                k, tkey_ch[k],
+                touch_st.base_cal[k][0],
+                touch_st.raw[k][0],
+                touch_st.delta[k],
+                touch_st.pressed[k],
+                (unsigned long)touch_st.presses[k]);
+        }
+    }
+    else if (strcmp(argv[0], "noise") == 0) {
+        for (k = 0; k < NUM_KEYS; k++) {
+            printf("k%d", k);
+            for (int h = 0; h < TOUCH_HOPS; h++) {
+                printf("  h%d %lu.%02lu rej %lu", h,
+                    (unsigned long)(touch_st.noise[k][h] >> 4), (unsigned long)(((touch_st.noise[k][h] & 0x0F) * 100) >> 4),
+                    (unsigned long)touch_st.rejects[k][h]);
+            }
+            printf("\n");
+        }
+    }
+    else if (strcmp(argv[0], "frame") == 0) {
+        printf("frame %u fast %u idle %lu prox %lu touch %lu water %lu guard %lu\n",
+            touch_frame.cls, touch_frame.fast,
+            (unsigned long)touch_frame.count[FRAME_IDLE],
+            (unsigned long)touch_frame.count[FRAME_PROXIMITY],
+            (unsigned long)touch_frame.count[FRAME_TOUCH],
+            (unsigned long)touch_frame.count[FRAME_WATER],
+            (unsigned long)touch_frame.count[FRAME_GUARD]);
+    }
+    else if (strcmp(argv[0], "trace") == 0 && argc == 2) {
+        touch_cfg.trace = (argv[1][0] == '1');
+        printf("trace %u\n", touch_cfg.trace);
+    }
+    else if (strcmp(argv[0], "gest") == 0) {
+        if (argc == 2) {
+            gesture.enabled = (argv[1][0] == '1');
+            Gesture_Reset(&gesture);
+        }
+        printf("gest %u tap %lu double %lu long %lu fwd %lu back %lu lost %lu\n", gesture.enabled,
+            (unsigned long)gesture.count[GESTURE_TAP],
+            (unsigned long)gesture.count[GESTURE_DOUBLE_TAP],
+            (unsigned long)gesture.count[GESTURE_LONG_PRESS],
+            (unsigned long)gesture.count[GESTURE_SWIPE_FWD],
+            (unsigned long)gesture.count[GESTURE_SWIPE_BACK],
+            (unsigned long)gesture.lost);
+    }
+    else if (strcmp(argv[0], "clk") == 0) {
+        if (argc == 2) {
+            if (strcmp(argv[1], "low") == 0) clock_pol.mode = CLOCK_FORCE_LOW;
+            else if (strcmp(argv[1], "high") == 0) clock_pol.mode = CLOCK_FORCE_HIGH;
+            else clock_pol.mode = CLOCK_AUTO;
+        }
+        printf("clk %u MHz %s, low %lu ms, high %lu ms, switches %lu, cycles %u%% of fixed %u MHz\n",
+            clock_pol.mhz[clock_pol.level],
+            clock_pol.mode == CLOCK_FORCE_LOW ? "low" : clock_pol.mode == CLOCK_FORCE_HIGH ? "high" : "auto",
+            (unsigned long)(clock_pol.time_us[CLOCK_LOW] / 1000),
+            (unsigned long)(clock_pol.time_us[CLOCK_HIGH] / 1000),
+            (unsigned long)clock_pol.switches,
+            ClockPolicy_CyclePct(&clock_pol), clock_pol.mhz[CLOCK_HIGH]);
+    }
+    else if (strcmp(argv[0], "usb") == 0) {
+        USB_TraceDump();
+    }
+    else if (strcmp(argv[0], "health") == 0) {
+        HealthBlock b;
+        Health_GetBlock((uint8_t *)&b);
+        printf("health rail 0x%04X flat 0x%04X pressed 0x%04X faults %lu rebase %lu\n",
+            b.rail, b.flat, b.pressed, (unsigned long)b.faults, (unsigned long)b.rebaselines);
+        printf("dropped %lu resets %lu stalls %lu overruns %lu timeouts %lu\n",
+            (unsigned long)b.dropped, (unsigned long)b.bus_resets,
+            (unsigned long)b.stalls, (unsigned long)b.overruns, (unsigned long)b.timeouts);
+        printf("wdt resets %lu stalled 0x%02X\n", (unsigned long)b.wdt_resets, b.wdt_stalled);
+    }
+    else {
+        printf("ERR cmd\n");
+    }
+}
+
+/**
+ * Feed one received character into the line assembler.
+ */
+void Console_Feed(char c) {
+    if (c == '\r' || c == '\n') {
+        char *argv[CONSOLE_MAX_ARGS];
+        int argc = 0;
+        char *p = console.line;
+
+        if (console.overflow) {
+            printf("ERR len\n");
+        } else if (console.len > 0) {
+            console.line[console.len] = '\0';
+            // Split on spaces in place
+            while (*p && argc < CONSOLE_MAX_ARGS) {
+                while (*p == ' ') *p++ = '\0';
+                if (*p == '\0') break;
+                argv[argc++] = p;
+                while (*p && *p != ' ') p++;
+            }
+            if (argc > 0) Console_Exec(argc, argv);
+        }
+        console.len = 0;
+        console.overflow = 0;
+    }
+    else if (console.len < CONSOLE_LINE_MAX - 1) {
+        console.line[console.len++] = c;
+    }
+    else {
+        console.overflow = 1;
+    }
+}
+
+/**
+ * Store one received byte (UART1 RX interrupt context)
+ */
+void Console_RxPush(char c) {
+    uint8_t next = (console.rx_head + 1) & (CONSOLE_RX_LEN - 1);
+
+    if (next == console.rx_tail) {
+        console.rx_lost++;
+        return;
+    }
+    console.rx[console.rx_head] = c;
+    console.rx_head = next;
+}
+
+/**
+ * Parse the bytes received since the last call. Call once per scan.
+ */
+void Console_Poll(void) {
+    while (console.rx_tail != console.rx_head) {
+        char c = console.rx[console.rx_tail];
+        console.rx_tail = (console.rx_tail + 1) & (CONSOLE_RX_LEN - 1);
+        Console_Feed(c);
+    }
+    if (console.rx_lost != console.rx_lost_seen) {
+        // The line being assembled has a gap, do not execute it
+        console.rx_lost_seen = console.rx_lost;
+        console.overflow = 1;
+    }
+}
+
+#endif
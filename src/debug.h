@@ -1,14 +1,29 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
 #include "stdio.h" 
 #include "CH58x_common.h" // Ensure this is included for the register definitions
 
+// NOTE: Every hardware poll is bounded. A poll that gives up is counted here
+// (UART TX below, TouchKey conversion in main.c) instead of hanging the firmware.
+#define UART_TX_TIMEOUT 20000   // FIFO-full poll iterations, several byte times at 115200
+volatile uint32_t HwPollTimeouts;
+
 // Function to redirect printf output to UART1
 __attribute__((used)) 
 int _write(int fd, char *buf, int size) {
     int i;
+    (void)fd; // stdout and stderr both go to UART1
     for (i = 0; i < size; i++) {
         // 1. Wait until the Transmit FIFO is NOT full
         // R8_UART1_TFC is the Transmitter FIFO Count (how many bytes are waiting to be sent)
-        while (R8_UART1_TFC == UART_FIFO_SIZE); 
+        uint32_t n = UART_TX_TIMEOUT;
+        while (R8_UART1_TFC == UART_FIFO_SIZE) {
+            if (--n == 0) {
+                HwPollTimeouts++;
+                return size; // UART stuck: drop the rest of the output
+            }
+        }
         
         // 2. Write the byte to the Transmit Holding Register (THR)
         R8_UART1_THR = *buf++; // Use the correct THR register
@@ -17,10 +32,25 @@ int _write(int fd, char *buf, int size) {
 }
 
 
+/**
+ * Wait until UART1 has shifted out everything (before its clock changes)
+ */
+void Debug_Drain(void) {
+    uint32_t n = UART_TX_TIMEOUT;
+    while (!(R8_UART1_LSR & RB_LSR_TX_ALL_EMP)) {
+        if (--n == 0) {
+            HwPollTimeouts++;
+            return;
+        }
+    }
+}
+
 void DebugInit(void)
 {
     GPIOA_SetBits(GPIO_Pin_9);
     GPIOA_ModeCfg(GPIO_Pin_8, GPIO_ModeIN_PU);
     GPIOA_ModeCfg(GPIO_Pin_9, GPIO_ModeOut_PP_5mA);
     UART1_DefInit();
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef DFU_H
+#define DFU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// --- In-application firmware update (vendor requests on EP0) ---
+//
+// The host streams the new image in 64-byte control OUT packets. The USB ISR
+// only copies packets into one of two page buffers (Dfu_Write); the main loop
+// erases one sector ahead of the write pointer and programs full pages
+// (Dfu_Process), so receive, erase and program overlap. Once the whole image is
+// in the staging slot it is read back and CRC32-checked, and a pending record is
+// written so the image is swapped into place on the next reboot.
+//
+// START and ABORT arrive in the ISR but reset the whole context, which the main
+// loop may be in the middle of using. The ISR only posts them (Dfu_PostStart,
+// Dfu_PostAbort) and Dfu_Process() carries them out between flash operations.
+//
+// Flash goes through DfuFlashOps; bench/test_dfu runs this file against a RAM
+// flash model that enforces erase-before-program.
+//
+// Host sequence:
+//   DFU_REQ_START   OUT  8 bytes: image size (LE32), image CRC32 (LE32)
+//   DFU_REQ_DATA    OUT  64 bytes (last packet may be shorter), wValue = sequence
+//   DFU_REQ_STATUS  IN   DfuStatusBlock, poll until state == DFU_READY
+//   DFU_REQ_REBOOT  no data stage, reboots and swaps in the staged image
+
+#define DFU_REQ_START   0xD0
+#define DFU_REQ_DATA    0xD1
+#define DFU_REQ_STATUS  0xD2
+#define DFU_REQ_REBOOT  0xD3
+#define DFU_REQ_ABORT   0xD4
+
+#define DFU_PKT_SIZE    64          // EP0 packet size
+#define DFU_PAGE_SIZE   256         // Program unit / RAM buffer size
+#define DFU_SECTOR_SIZE 4096        // CodeFlash erase unit
+#define DFU_SLOT_ADDR   0x00038000  // Staging slot: upper half of 448K CodeFlash
+#define DFU_SLOT_SIZE   0x00038000
+#define DFU_MAGIC       0x55464421  // "!DFU"
+
+typedef enum {
+    DFU_IDLE = 0,
+    DFU_RECEIVING,
+    DFU_VERIFYING,
+    DFU_READY,
+    DFU_ERROR
+} DfuState;
+
+typedef enum {
+    DFU_OK = 0,
+    DFU_ERR_STATE,      // Request not valid in the current state
+    DFU_ERR_SIZE,       // Image too large / packet length wrong
+    DFU_ERR_SEQ,        // Packet out of sequence
+    DFU_ERR_FLASH,      // Erase/program/read failed
+    DFU_ERR_CRC,        // Staged image does not match the announced CRC
+    DFU_BUSY            // No free page buffer, retry later
+} DfuStatus;
+
+// Image description, also the layout of the pending-swap record
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t crc;
+} DfuImageInfo;
+
+// Reply to DFU_REQ_STATUS (little endian, packed)
+typedef struct __attribute__((packed)) {
+    uint8_t  state;
+    uint8_t  error;
+    uint16_t seq;
+    uint32_t received;
+    uint32_t programmed;
+} DfuStatusBlock;
+
+// Flash backend. All functions return 0 on success.
+typedef struct {
+    int (*erase)(uint32_t addr, uint32_t len);
+    int (*program)(uint32_t addr, const uint8_t *buf, uint32_t len);
+    int (*read)(uint32_t addr, uint8_t *buf, uint32_t len);
+    int (*set_pending)(const DfuImageInfo *info);
+} DfuFlashOps;
+
+// Request posted by the ISR for the main loop
+typedef enum {
+    DFU_POST_NONE = 0,
+    DFU_POST_START,
+    DFU_POST_ABORT
+} DfuPost;
+
+typedef struct {
+    const DfuFlashOps *ops;
+
+    // Posted by the ISR, applied by Dfu_Process(). post_seq counts posts, so a
+    // post that lands while an earlier one is being applied is not lost.
+    volatile uint8_t post;      // DfuPost
+    volatile uint8_t post_seq;
+    uint8_t post_done;          // post_seq applied so far (main loop)
+    volatile uint32_t post_size;
+    volatile uint32_t post_crc;
+
+    volatile uint8_t state;
+    volatile uint8_t error;
+    DfuImageInfo image;
+    uint16_t seq;               // Next expected packet sequence number
+    uint32_t received;          // Bytes accepted from the host (ISR side)
+    uint32_t programmed;        // Bytes written to the slot (main loop side)
+    uint32_t erased;            // End of the erased part of the slot
+    uint32_t verified;          // Bytes read back for the CRC check
+    uint32_t crc_acc;
+    uint16_t fill;              // Bytes in the buffer being filled
+    uint8_t wr;                 // Buffer being filled by the ISR
+    uint8_t rd;                 // Buffer to be programmed next
+    volatile uint8_t full[2];   // Buffer handed over to the main loop
+    __attribute__((aligned(4))) uint8_t buf[2][DFU_PAGE_SIZE];
+} DfuCtx;
+
+/**
+ * Running CRC32 (IEEE 802.3, reflected). Start with 0xFFFFFFFF and invert the result.
+ */
+uint32_t Dfu_Crc32(uint32_t crc, const uint8_t *p, uint32_t len) {
+    static const uint32_t nib[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ nib[crc & 0x0F];
+        crc = (crc >> 4) ^ nib[crc & 0x0F];
+    }
+    return crc;
+}
+
+void Dfu_Init(DfuCtx *d, const DfuFlashOps *ops) {
+    memset(d, 0, sizeof(*d));
+    d->ops = ops;
+}
+
+/**
+ * Clear the transfer state, leaving ops and the ISR's posts alone
+ */
+static void Dfu_Reset(DfuCtx *d) {
+    memset((uint8_t *)&d->state, 0, sizeof(*d) - offsetof(DfuCtx, state));
+}
+
+/**
+ * True while a posted START/ABORT has not been carried out yet
+ */
+uint8_t Dfu_PostPending(const DfuCtx *d) {
+    return d->post_seq != d->post_done;
+}
+
+uint8_t Dfu_Active(const DfuCtx *d) {
+    return d->state == DFU_RECEIVING || d->state == DFU_VERIFYING || Dfu_PostPending(d);
+}
+
+/**
+ * True when the ISR has room for another packet
+ */
+uint8_t Dfu_CanAccept(const DfuCtx *d) {
+    return !d->full[d->wr];
+}
+
+static void Dfu_Fail(DfuCtx *d, DfuStatus err) {
+    d->error = err;
+    d->state = DFU_ERROR;
+}
+
+/**
+ * Begin a new transfer (main loop, or a context that owns d). A running transfer is restarted.
+ */
+DfuStatus Dfu_Start(DfuCtx *d, uint32_t size, uint32_t crc) {
+    Dfu_Reset(d);
+    if (size == 0 || size > DFU_SLOT_SIZE) {
+        Dfu_Fail(d, DFU_ERR_SIZE);
+        return DFU_ERR_SIZE;
+    }
+    d->image.magic = DFU_MAGIC;
+    d->image.size = size;
+    d->image.crc = crc;
+    d->state = DFU_RECEIVING;
+    return DFU_OK;
+}
+
+/**
+ * Drop the transfer in progress (main loop)
+ */
+void Dfu_Abort(DfuCtx *d) {
+    Dfu_Reset(d);
+}
+
+/**
+ * Ask the main loop to start a transfer (ISR context). The size is checked
+ * right away so the request can be STALLed; nothing else is touched.
+ */
+DfuStatus Dfu_PostStart(DfuCtx *d, uint32_t size, uint32_t crc) {
+    if (size == 0 || size > DFU_SLOT_SIZE) return DFU_ERR_SIZE;
+    d->post_size = size;
+    d->post_crc = crc;
+    d->post = DFU_POST_START;
+    d->post_seq++;
+    return DFU_OK;
+}
+
+/**
+ * Ask the main loop to abort (ISR context)
+ */
+void Dfu_PostAbort(DfuCtx *d) {
+    d->post = DFU_POST_ABORT;
+    d->post_seq++;
+}
+
+/**
+ * Accept one data packet (ISR context). Only copies into a page buffer.
+ */
+DfuStatus Dfu_Write(DfuCtx *d, uint16_t seq, const uint8_t *data, uint16_t len) {
+    uint32_t left = d->image.size - d->received;
+
+    if (Dfu_PostPending(d)) return DFU_BUSY;    // Context is about to be reset
+    if (d->state != DFU_RECEIVING) return DFU_ERR_STATE;
+    if (d->full[d->wr]) return DFU_BUSY;
+    if (seq != d->seq) {
+        Dfu_Fail(d, DFU_ERR_SEQ);
+        return DFU_ERR_SEQ;
+    }
+    // Every packet but the last must be full so packets never straddle pages
+    if (len > left || (len != DFU_PKT_SIZE && len != left)) {
+        Dfu_Fail(d, DFU_ERR_SIZE);
+        return DFU_ERR_SIZE;
+    }
+
+    memcpy(&d->buf[d->wr][d->fill], data, len);
+    d->fill += len;
+    d->received += len;
+    d->seq++;
+
+    if (d->fill == DFU_PAGE_SIZE || d->received == d->image.size) {
+        // Pad the tail with erased-flash bytes and hand the page over
+        memset(&d->buf[d->wr][d->fill], 0xFF, DFU_PAGE_SIZE - d->fill);
+        d->full[d->wr] = 1;
+        d->wr ^= 1;
+        d->fill = 0;
+    }
+    return DFU_OK;
+}
+
+/**
+ * Carry out a posted START/ABORT, or advance erase/program/verify by at most
+ * one flash operation (main loop). Returns 1 when page buffers were released.
+ */
+uint8_t Dfu_Process(DfuCtx *d) {
+    const DfuFlashOps *ops = d->ops;
+    uint32_t n;
+
+    if (Dfu_PostPending(d)) {
+        // Snapshot first: a post arriving meanwhile leaves post_seq ahead and runs next call
+        uint8_t seq = d->post_seq;
+        uint8_t post = d->post;
+        uint32_t size = d->post_size, crc = d->post_crc;
+
+        if (post == DFU_POST_START) Dfu_Start(d, size, crc);
+        else Dfu_Abort(d);
+        d->post_done = seq;
+        return 1;
+    }
+
+    if (d->state == DFU_RECEIVING) {
+        // Program a full page as soon as its sector is erased
+        if (d->full[d->rd] && d->erased > d->programmed) {
+            n = d->image.size - d->programmed;
+            if (n > DFU_PAGE_SIZE) n = DFU_PAGE_SIZE;
+            n = (n + 3) & ~3u;  // Program in whole words
+            if (ops->program(DFU_SLOT_ADDR + d->programmed, d->buf[d->rd], n)) {
+                Dfu_Fail(d, DFU_ERR_FLASH);
+                return 0;
+            }
+            d->programmed += DFU_PAGE_SIZE;
+            if (d->programmed >= d->image.size) {
+                d->programmed = d->image.size;
+                d->verified = 0;
+                d->crc_acc = 0xFFFFFFFF;
+                d->state = DFU_VERIFYING;
+            }
+            d->full[d->rd] = 0;
+            d->rd ^= 1;
+            return 1;
+        }
+        // Otherwise keep one sector erased ahead of the write pointer
+        if (d->erased < d->image.size && d->erased <= d->programmed + DFU_SECTOR_SIZE) {
+            if (ops->erase(DFU_SLOT_ADDR + d->erased, DFU_SECTOR_SIZE)) {
+                Dfu_Fail(d, DFU_ERR_FLASH);
+                return 0;
+            }
+            d->erased += DFU_SECTOR_SIZE;
+        }
+    }
+    else if (d->state == DFU_VERIFYING) {
+        // Read back one page per call into the (now idle) page buffer
+        n = d->image.size - d->verified;
+        if (n > DFU_PAGE_SIZE) n = DFU_PAGE_SIZE;
+        if (ops->read(DFU_SLOT_ADDR + d->verified, d->buf[0], n)) {
+            Dfu_Fail(d, DFU_ERR_FLASH);
+            return 0;
+        }
+        d->crc_acc = Dfu_Crc32(d->crc_acc, d->buf[0], n);
+        d->verified += n;
+        if (d->verified == d->image.size) {
+            if ((d->crc_acc ^ 0xFFFFFFFF) != d->image.crc) {
+                Dfu_Fail(d, DFU_ERR_CRC);
+            } else if (ops->set_pending(&d->image)) {
+                Dfu_Fail(d, DFU_ERR_FLASH);
+            } else {
+                d->state = DFU_READY;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Fill the DFU_REQ_STATUS reply. Returns its length.
+ */
+uint8_t Dfu_GetStatus(const DfuCtx *d, uint8_t *out) {
+    DfuStatusBlock st;
+    st.state = d->state;
+    st.error = d->error;
+    st.seq = d->seq;
+    st.received = d->received;
+    st.programmed = d->programmed;
+    memcpy(out, &st, sizeof(st));
+    return sizeof(st);
+}
+
+#endif
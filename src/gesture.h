@@ -0,0 +1,216 @@
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdint.h>
+#include "keyboard_def.h"
+#include "touch.h"
+#include "touch_event.h"
+
+// --- Gesture recogniser on top of the touch event stream ---
+//
+// With gestures enabled ("gest 1") the pads stop acting as plain keys and the
+// event stream is matched against:
+//   tap          short touch of one key           -> that key's key_map code
+//   double tap   two taps on the same key         -> gesture_map[GESTURE_DOUBLE_TAP]
+//   long press   one key held                     -> gesture_map[GESTURE_LONG_PRESS]
+//   swipe        touches across adjacent keys in one direction (tkey_ch order,
+//                adjacent entries in KEYBOARD_KEYS are adjacent pads)
+// Evaluation is incremental: Gesture_Event() per event, Gesture_Tick() once per
+// sweep for the timeouts. A tap is held back until it cannot become part of a
+// double tap or a swipe any more. Timestamps are the scan clock microseconds of
+// the events, not the time of the call, so bench/test_gesture drives it with
+// written event sequences and gets the same result as the main loop.
+
+#define GESTURE_TAP_MAX_MS 250      // Longest touch that still counts as a tap
+#define GESTURE_DOUBLE_GAP_MS 300   // Longest release-to-touch gap inside a double tap
+#define GESTURE_LONG_MS 700         // Hold time of a long press
+#define GESTURE_SWIPE_GAP_MS 200    // Longest touch-to-touch gap between adjacent keys of a swipe
+#define GESTURE_SWIPE_KEYS (NUM_KEYS < 3 ? NUM_KEYS : 3)  // Keys a swipe has to cross
+#define GESTURE_TAPS_MAX 4          // Taps held back at once
+#define GESTURE_OUT_LEN 4           // Recognised gestures waiting for Gesture_Pop()
+
+typedef enum {
+    GESTURE_TAP = 0,
+    GESTURE_DOUBLE_TAP,
+    GESTURE_LONG_PRESS,
+    GESTURE_SWIPE_FWD,          // Towards higher key index
+    GESTURE_SWIPE_BACK,         // Towards lower key index
+    GESTURE_COUNT
+} GestureType;
+
+// Gesture -> HID code (keyboard usage or CONSUMER(usage)); a tap sends the key's own code
+const uint16_t gesture_map[GESTURE_COUNT] = {
+    0,                  // Tap: touch_cfg.key_map[key]
+    0x28,               // Double tap: Enter
+    0x29,               // Long press: Escape
+#ifdef CONFIG_HID_CONSUMER
+    CONSUMER(0xE9),     // Swipe forward: Volume Up
+    CONSUMER(0xEA),     // Swipe back: Volume Down
+#else
+    0x4B,               // Swipe forward: Page Up
+    0x4E,               // Swipe back: Page Down
+#endif
+};
+
+typedef struct {
+    uint8_t type;               // GestureType
+    uint8_t key;                // Key it ended on
+} Gesture;
+
+typedef struct {
+    uint8_t  enabled;           // Pads drive the recogniser instead of acting as keys
+    uint16_t down;              // Keys touched right now (bitmask)
+
+    // Session: from the first touch until every key is released again
+    uint16_t touched;           // Keys touched during the session
+    uint32_t start_us;
+    uint8_t  consumed;          // Session already produced a long press or swipe
+
+    // Swipe run: touches on successive adjacent keys
+    uint8_t  run_key;           // Last key of the run
+    int8_t   run_dir;           // +1 / -1, 0 until the second key
+    uint8_t  run_len;           // Keys in the run, 0 = none
+    uint32_t run_us;            // Touch time of run_key
+
+    // Taps held back (oldest first)
+    uint8_t  taps[GESTURE_TAPS_MAX];
+    uint8_t  n_taps;
+    uint32_t tap_up_us;         // Release time of the newest one
+
+    Gesture  out[GESTURE_OUT_LEN];
+    uint8_t  n_out;
+    uint32_t count[GESTURE_COUNT];
+    uint32_t lost;              // Gestures dropped, Gesture_Pop() not called often enough
+} GestureState;
+
+GestureState gesture;
+
+void Gesture_Emit(GestureState *g, uint8_t type, uint8_t key) {
+    g->count[type]++;
+    if (g->n_out == GESTURE_OUT_LEN) {
+        g->lost++;
+        return;
+    }
+    g->out[g->n_out].type = type;
+    g->out[g->n_out].key = key;
+    g->n_out++;
+}
+
+/**
+ * Emit the held-back taps, except the newest one if keep_last is set
+ */
+void Gesture_FlushTaps(GestureState *g, uint8_t keep_last) {
+    uint8_t n = (keep_last && g->n_taps) ? g->n_taps - 1 : g->n_taps;
+
+    for (uint8_t i = 0; i < n; i++) Gesture_Emit(g, GESTURE_TAP, g->taps[i]);
+    if (n < g->n_taps) g->taps[0] = g->taps[n];
+    g->n_taps -= n;
+}
+
+/**
+ * Forget everything in flight (keeps enabled and the counters)
+ */
+void Gesture_Reset(GestureState *g) {
+    g->down = 0;
+    g->consumed = 0;
+    g->run_len = 0;
+    g->n_taps = 0;
+    g->n_out = 0;
+}
+
+/**
+ * Feed one touch event
+ */
+void Gesture_Event(GestureState *g, const TouchEvent *ev) {
+    uint16_t bit = 1u << ev->key;
+
+    if (ev->down) {
+        int8_t step = (int8_t)ev->key - (int8_t)g->run_key;
+
+        if (g->down == 0) {
+            g->touched = 0;
+            g->start_us = ev->t_us;
+            g->consumed = 0;
+        }
+        g->down |= bit;
+        g->touched |= bit;
+
+        if (g->run_len && (step == 1 || step == -1) && (g->run_dir == 0 || step == g->run_dir)
+            && ev->t_us - g->run_us <= GESTURE_SWIPE_GAP_MS * 1000u) {
+            // Next key of a swipe; taps so far may have been its start
+            g->run_dir = step;
+            if (++g->run_len >= GESTURE_SWIPE_KEYS) {
+                g->n_taps = 0;
+                g->run_len = 0;
+                g->consumed = 1;
+                Gesture_Emit(g, step > 0 ? GESTURE_SWIPE_FWD : GESTURE_SWIPE_BACK, ev->key);
+            }
+        } else {
+            // Not a swipe continuation: held taps are final, unless the newest
+            // one is on this key and may become a double tap
+            Gesture_FlushTaps(g, g->n_taps && g->taps[g->n_taps - 1] == ev->key);
+            g->run_len = 1;
+            g->run_dir = 0;
+        }
+        g->run_key = ev->key;
+        g->run_us = ev->t_us;
+        return;
+    }
+
+    g->down &= ~bit;
+    if (g->down || g->consumed) return;
+
+    // Session over: a tap is one key, touched briefly
+    if (g->touched != bit || ev->t_us - g->start_us > GESTURE_TAP_MAX_MS * 1000u) return;
+
+    if (g->n_taps && g->taps[g->n_taps - 1] == ev->key
+        && g->start_us - g->tap_up_us <= GESTURE_DOUBLE_GAP_MS * 1000u) {
+        g->n_taps--;
+        Gesture_FlushTaps(g, 0);
+        Gesture_Emit(g, GESTURE_DOUBLE_TAP, ev->key);
+        return;
+    }
+    if (g->n_taps == GESTURE_TAPS_MAX) Gesture_FlushTaps(g, 0);
+    g->taps[g->n_taps++] = ev->key;
+    g->tap_up_us = ev->t_us;
+}
+
+/**
+ * Once per sweep: long press and release of held-back taps
+ */
+void Gesture_Tick(GestureState *g, uint32_t now_us) {
+    if (g->down && !g->consumed && (g->touched & (g->touched - 1)) == 0
+        && now_us - g->start_us >= GESTURE_LONG_MS * 1000u) {
+        uint8_t key = 0;
+        while (!(g->touched & (1u << key))) key++;
+        Gesture_FlushTaps(g, 0);
+        Gesture_Emit(g, GESTURE_LONG_PRESS, key);
+        g->consumed = 1;
+    }
+
+    if (g->n_taps && g->down == 0
+        && now_us - g->tap_up_us > GESTURE_DOUBLE_GAP_MS * 1000u
+        && now_us - g->run_us > GESTURE_SWIPE_GAP_MS * 1000u) {
+        Gesture_FlushTaps(g, 0);
+    }
+}
+
+/**
+ * Take the oldest recognised gesture. Returns 0 if there is none.
+ */
+uint8_t Gesture_Pop(GestureState *g, Gesture *out) {
+    if (g->n_out == 0) return 0;
+    *out = g->out[0];
+    g->n_out--;
+    for (uint8_t i = 0; i < g->n_out; i++) g->out[i] = g->out[i + 1];
+    return 1;
+}
+
+/**
+ * HID code a gesture maps to
+ */
+uint16_t Gesture_Code(const Gesture *ge) {
+    return (ge->type == GESTURE_TAP) ? touch_cfg.key_map[ge->key] : gesture_map[ge->type];
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+#include "debug.h"
+#include "touch.h"
+#include "hid_report.h"
+#include "usb_device.h"
+#include "scan_clock.h"
+
+// --- Channel health and error counters ---
+//
+// Per key, every frame:
+//   rail    hop-0 raw reading pinned at 0 or full scale (pad shorted / pin fault)
+//   flat    hop-0 raw reading identical for HEALTH_FLAT_MS; a connected pad
+//           always shows a few counts of noise, so this is an open pad or dead channel
+//   stuck   key held for HEALTH_STUCK_MS: the baseline is assumed wrong and is
+//           re-acquired from the current reading, which releases the key
+//   low     reading far above the baseline (delta below -thres) for HEALTH_LOW_MS,
+//           e.g. calibrated with a finger on the pad: re-acquired the same way
+// A key with a rail or flat fault is reported as released until the fault clears.
+//
+// The host reads HealthBlock with vendor request HEALTH_REQ_GET (IN, see main.c),
+// the console prints it with "health".
+
+#define HEALTH_REQ_GET 0xD8     // Vendor IN request, reply is HealthBlock
+
+#define HEALTH_RAW_MAX 0x0FFF   // TouchKey conversion full scale
+#define HEALTH_RAIL_MARGIN 8    // Counts from 0 / full scale that count as pinned
+#define HEALTH_FLAT_MS 2000     // Unchanged reading for this long = zero variance
+#define HEALTH_STUCK_MS 30000   // Longest plausible key hold
+#define HEALTH_LOW_MS 1000      // Reading above baseline for this long = bad baseline
+
+#define HEALTH_BLOCK_VERSION 2
+_Static_assert(NUM_KEYS <= 16, "HealthBlock key bitmasks are 16 bit");
+
+typedef struct {
+    uint16_t rail;              // Keys with a rail fault (bitmask)
+    uint16_t flat;              // Keys with a zero-variance fault (bitmask)
+    uint16_t last_raw[NUM_KEYS];
+    uint32_t flat_us[NUM_KEYS]; // Time the reading has been unchanged
+    uint32_t held_us[NUM_KEYS]; // Time the key has been held
+    uint32_t low_us[NUM_KEYS];  // Time the reading has been far above baseline
+    uint32_t faults;            // Rail/flat faults raised
+    uint32_t rebaselines;       // Stuck/low re-acquisitions
+    uint32_t wdt_resets;        // Watchdog resets recovered from (see recovery.h)
+    uint8_t  wdt_stalled;       // PROGRESS_* bits missing at the last watchdog reset
+} HealthState;
+
+// Reply to HEALTH_REQ_GET (little endian, packed)
+typedef struct __attribute__((packed)) {
+    uint8_t  version;
+    uint8_t  num_keys;
+    uint16_t rail;
+    uint16_t flat;
+    uint16_t pressed;           // Debounced key state (bitmask)
+    uint32_t faults;
+    uint32_t rebaselines;
+    uint32_t dropped;           // HID reports lost to a full queue
+    uint32_t bus_resets;
+    uint32_t stalls;            // EP0 requests answered with STALL
+    uint32_t overruns;          // Scan frames the main loop missed
+    uint32_t timeouts;          // Hardware polls that gave up
+    uint32_t wdt_resets;
+    uint8_t  wdt_stalled;
+} HealthBlock;
+
+_Static_assert(sizeof(HealthBlock) <= sizeof(UsbReplyBuf), "HealthBlock must fit the EP0 reply buffer");
+
+HealthState health;
+
+/**
+ * Check key k after the frame has been processed (touch_st.raw/delta are
+ * current). frame_us is the scan period. Returns 1 if the key has a channel
+ * fault and must be treated as released.
+ */
+uint8_t Health_CheckKey(uint8_t k, uint32_t frame_us) {
+    uint16_t raw = touch_st.raw[k][0];
+    uint16_t bit = 1u << k;
+
+    if (raw <= HEALTH_RAIL_MARGIN || raw >= HEALTH_RAW_MAX - HEALTH_RAIL_MARGIN) {
+        if (!(health.rail & bit)) health.faults++;
+        health.rail |= bit;
+    } else {
+        health.rail &= ~bit;
+    }
+
+    if (raw != health.last_raw[k]) {
+        health.last_raw[k] = raw;
+        health.flat_us[k] = 0;
+        health.flat &= ~bit;
+    } else if (health.flat_us[k] < HEALTH_FLAT_MS * 1000u) {
+        health.flat_us[k] += frame_us;
+    } else if (!(health.flat & bit)) {
+        health.flat |= bit;
+        health.faults++;
+    }
+
+    health.held_us[k] = touch_st.pressed[k] ? health.held_us[k] + frame_us : 0;
+    health.low_us[k] = (touch_st.delta[k] < -(int16_t)touch_cfg.thres[k]) ? health.low_us[k] + frame_us : 0;
+    if (health.held_us[k] >= HEALTH_STUCK_MS * 1000u || health.low_us[k] >= HEALTH_LOW_MS * 1000u) {
+        Touch_Rebase(k);
+        health.held_us[k] = 0;
+        health.low_us[k] = 0;
+        health.rebaselines++;
+    }
+
+    return ((health.rail | health.flat) & bit) ? 1 : 0;
+}
+
+/**
+ * Snapshot the health state and the USB/scan error counters. Returns its length.
+ */
+uint8_t Health_GetBlock(uint8_t *out) {
+    HealthBlock b;
+    b.version = HEALTH_BLOCK_VERSION;
+    b.num_keys = NUM_KEYS;
+    b.rail = health.rail;
+    b.flat = health.flat;
+    b.pressed = 0;
+    for (uint8_t k = 0; k < NUM_KEYS; k++) {
+        if (touch_st.pressed[k]) b.pressed |= 1u << k;
+    }
+    b.faults = health.faults;
+    b.rebaselines = health.rebaselines;
+    b.dropped = hid_q.dropped;
+    b.bus_resets = UsbBusResetCount;
+    b.stalls = UsbStallCount;
+    b.overruns = scan_clk.overruns;
+    b.timeouts = HwPollTimeouts;
+    b.wdt_resets = health.wdt_resets;
+    b.wdt_stalled = health.wdt_stalled;
+    memcpy(out, &b, sizeof(b));
+    return sizeof(b);
+}
+
+#endif
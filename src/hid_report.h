@@ -0,0 +1,212 @@
+#ifndef HID_REPORT_H
+#define HID_REPORT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "keyboard_def.h"
+
+// --- Transport-agnostic HID report builder and queue ---
+//
+// The key engine builds reports into a small FIFO; Hid_Flush() drains it through
+// whichever HidTransport is active (USB EP1 in main.c, BLE HID-over-GATT in
+// ble_hid.h). Reports are never dropped because an endpoint was busy, only when
+// the queue itself overflows. Plain data handling, so bench/test_report runs it
+// on the host.
+//
+// Report layouts are chosen at compile time:
+//   default                8-byte boot keyboard report, no report IDs
+//   -DCONFIG_HID_NKRO      report protocol keyboard is ID 1: modifiers + one bit
+//                          per usage 0..KEYBOARD_USAGE_MAX, no rollover limit
+//   -DCONFIG_HID_CONSUMER  adds consumer control report ID 2 (one 16-bit usage)
+// In boot protocol (SET_PROTOCOL 0) only the plain boot report is sent, the host
+// ignores the report descriptor then. Reports are queued only when they differ
+// from the last one queued with the same layout (HidQueue_PushChanged).
+
+#if defined(CONFIG_HID_NKRO) || defined(CONFIG_HID_CONSUMER)
+#define HID_REPORT_IDS
+#endif
+#define HID_ID_KEYBOARD 1
+#define HID_ID_CONSUMER 2
+
+#define HID_KEY_SLOTS 6         // Keycode array entries in the boot report
+#define HID_ERR_ROLLOVER 0x01   // Boot report slots when more than HID_KEY_SLOTS keys are down
+#define HID_BOOT_LEN 8          // Boot keyboard report size
+#define HID_NKRO_BYTES ((KEYBOARD_USAGE_MAX + 8) / 8)
+#define HID_NKRO_LEN (1 + HID_NKRO_BYTES)   // Modifiers + usage bitmap (without report ID)
+#define HID_CONSUMER_LEN 3      // Report ID + 16-bit usage
+
+#if defined(CONFIG_HID_NKRO)
+#define HID_REPORT_MAX (1 + HID_NKRO_LEN)
+#elif defined(CONFIG_HID_CONSUMER)
+#define HID_REPORT_MAX (1 + HID_BOOT_LEN)
+#else
+#define HID_REPORT_MAX HID_BOOT_LEN
+#endif
+#define HID_QUEUE_LEN 8         // Must be a power of two
+
+// Which report an entry is. The wire bytes cannot tell: without report IDs (boot
+// protocol, default build) the first byte is the modifier mask.
+typedef enum {
+    HID_CH_KEYBOARD = 0,
+    HID_CH_CONSUMER,
+    HID_CHANNELS
+} HidChannel;
+
+typedef struct {
+    uint8_t ch;                 // HidChannel
+    uint8_t len;
+    uint8_t data[HID_REPORT_MAX];
+} HidReport;
+
+typedef struct {
+    HidReport slot[HID_QUEUE_LEN];
+    volatile uint8_t head;      // Next slot to write
+    volatile uint8_t tail;      // Next slot to send
+    HidReport refused[HID_CHANNELS];    // Last report the full queue refused per channel (len 0 = none)
+    uint32_t dropped;           // Reports lost to a full queue (never sent, not just retried)
+} HidQueue;
+
+typedef struct {
+    const char *name;
+    uint8_t (*ready)(void);                         // Can accept a report now
+    void (*send)(uint8_t ch, const uint8_t *buf, uint8_t len); // Hand one report to the transport
+    uint8_t max_batch;          // Reports per flush (USB: one per poll, BLE: per connection event)
+} HidTransport;
+
+/**
+ * Pack an 8-byte boot keyboard report. More than HID_KEY_SLOTS keys report
+ * ErrorRollOver in every slot. Returns the report length.
+ */
+uint8_t Report_PackBoot(uint8_t *out, uint8_t modifiers, const uint8_t *codes, uint8_t n) {
+    out[0] = modifiers;
+    out[1] = 0; // Reserved
+    for (uint8_t i = 0; i < HID_KEY_SLOTS; i++) {
+        out[2 + i] = (n > HID_KEY_SLOTS) ? HID_ERR_ROLLOVER : (i < n) ? codes[i] : 0;
+    }
+    return HID_BOOT_LEN;
+}
+
+/**
+ * Pack modifiers + usage bitmap (NKRO layout, without report ID).
+ * Usages above KEYBOARD_USAGE_MAX are not representable and skipped.
+ */
+uint8_t Report_PackNkro(uint8_t *out, uint8_t modifiers, const uint8_t *codes, uint8_t n) {
+    out[0] = modifiers;
+    memset(out + 1, 0, HID_NKRO_BYTES);
+    for (uint8_t i = 0; i < n; i++) {
+        if (codes[i] <= KEYBOARD_USAGE_MAX) out[1 + (codes[i] >> 3)] |= 1u << (codes[i] & 7);
+    }
+    return HID_NKRO_LEN;
+}
+
+/**
+ * Pack a consumer control report (report ID 2, one usage, 0 = released)
+ */
+uint8_t Report_PackConsumer(uint8_t *out, uint16_t usage) {
+    out[0] = HID_ID_CONSUMER;
+    out[1] = usage & 0xFF;
+    out[2] = usage >> 8;
+    return HID_CONSUMER_LEN;
+}
+
+/**
+ * Pack the keyboard report in the layout for the active protocol
+ * (boot = 1 after SET_PROTOCOL 0). Returns the report length.
+ */
+uint8_t Report_PackKeys(uint8_t *out, uint8_t boot, uint8_t modifiers, const uint8_t *codes, uint8_t n) {
+#ifdef HID_REPORT_IDS
+    if (!boot) {
+        out[0] = HID_ID_KEYBOARD;
+#ifdef CONFIG_HID_NKRO
+        return 1 + Report_PackNkro(out + 1, modifiers, codes, n);
+#else
+        return 1 + Report_PackBoot(out + 1, modifiers, codes, n);
+#endif
+    }
+#else
+    (void)boot; // Without report IDs both protocols use the boot layout
+#endif
+    return Report_PackBoot(out, modifiers, codes, n);
+}
+
+uint8_t HidQueue_Empty(const HidQueue *q) {
+    return q->head == q->tail;
+}
+
+/**
+ * Reports that can still be pushed
+ */
+uint8_t HidQueue_Free(const HidQueue *q) {
+    return (q->tail - q->head - 1) & (HID_QUEUE_LEN - 1);
+}
+
+/**
+ * Append a report on channel ch. Returns 0 if the queue is full; the caller
+ * retries or gives up (a report that is too long is dropped here).
+ */
+uint8_t HidQueue_Push(HidQueue *q, uint8_t ch, const uint8_t *buf, uint8_t len) {
+    uint8_t next = (q->head + 1) & (HID_QUEUE_LEN - 1);
+    HidReport *r;
+
+    if (len > HID_REPORT_MAX) {
+        q->dropped++;
+        return 0;
+    }
+    if (next == q->tail) return 0;
+    r = &q->slot[q->head];
+    r->ch = ch;
+    r->len = len;
+    memcpy(r->data, buf, len);
+    q->head = next;
+    return 1;
+}
+
+uint8_t HidReport_Same(const HidReport *r, const uint8_t *buf, uint8_t len) {
+    return len == r->len && memcmp(r->data, buf, len) == 0;
+}
+
+/**
+ * Append a report unless it equals *last, the last one queued on its channel.
+ * Returns 0 only if it had to be queued and the queue was full (retry later).
+ * NOTE: the caller retries with its state at that time, so a refused report is
+ * only counted as dropped once a different one (or *last again) takes its place.
+ */
+uint8_t HidQueue_PushChanged(HidQueue *q, HidReport *last, uint8_t ch, const uint8_t *buf, uint8_t len) {
+    HidReport *ref = &q->refused[ch];
+
+    if (HidReport_Same(last, buf, len)) {
+        if (ref->len) q->dropped++;
+        ref->len = 0;
+        return 1;
+    }
+    if (!HidQueue_Push(q, ch, buf, len)) {
+        if (len > HID_REPORT_MAX) return 0;
+        if (ref->len && !HidReport_Same(ref, buf, len)) q->dropped++;
+        ref->len = len;
+        memcpy(ref->data, buf, len);
+        return 0;
+    }
+    if (ref->len && !HidReport_Same(ref, buf, len)) q->dropped++;
+    ref->len = 0;
+    last->ch = ch;
+    last->len = len;
+    memcpy(last->data, buf, len);
+    return 1;
+}
+
+/**
+ * Send queued reports while the transport is ready, at most max_batch.
+ * Returns the number of reports sent.
+ */
+uint8_t Hid_Flush(HidQueue *q, const HidTransport *t) {
+    uint8_t sent = 0;
+    while (sent < t->max_batch && !HidQueue_Empty(q) && t->ready()) {
+        const HidReport *r = &q->slot[q->tail];
+        t->send(r->ch, r->data, r->len);
+        q->tail = (q->tail + 1) & (HID_QUEUE_LEN - 1);
+        sent++;
+    }
+    return sent;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef KEYBOARD_DEF_H
+#define KEYBOARD_DEF_H
+
+#include <stdint.h>
+
+// --- Board / keyboard definition ---
+//
+// The single place to add, remove or reorder touch keys. Everything else is
+// expanded from KEYBOARD_KEYS at compile time: the channel order (tkey_ch[]),
+// the default keymap, NUM_KEYS, the GPIO mask used in Touch_Setup() and the
+// checks against the HID report descriptor.
+//
+//   KEY(name, touch channel, default HID keycode)
+//
+// The keycode is a Keyboard page usage, or CONSUMER(usage) for a Consumer page
+// usage (volume, media keys), which needs -DCONFIG_HID_CONSUMER (hid_report.h).
+//
+// Keys are scanned in this order and adjacent lines are adjacent pads.
+
+#define KEYBOARD_KEYS(KEY) \
+    KEY(LEFT,  5, 0x50)  /* Left arrow  */ \
+    KEY(UP,    2, 0x52)  /* Up arrow    */ \
+    KEY(RIGHT, 4, 0x4F)  /* Right arrow */
+
+// Optional guard/shield pad around the keys (TouchKey channel). When it sees a
+// touch, no key is reported (water film, palm). Leave undefined if there is none.
+// #define KEYBOARD_GUARD_CH 3
+
+// TouchKey channel -> GPIOA pin (the TouchKey inputs are the ADC AINx pins)
+#define TKEY_PIN_0  GPIO_Pin_4
+#define TKEY_PIN_1  GPIO_Pin_5
+#define TKEY_PIN_2  GPIO_Pin_12
+#define TKEY_PIN_3  GPIO_Pin_13
+#define TKEY_PIN_4  GPIO_Pin_14
+#define TKEY_PIN_5  GPIO_Pin_15
+#define TKEY_PIN_6  GPIO_Pin_3
+#define TKEY_PIN_7  GPIO_Pin_2
+#define TKEY_PIN_8  GPIO_Pin_1
+#define TKEY_PIN_9  GPIO_Pin_0
+#define TKEY_PIN_10 GPIO_Pin_6
+#define TKEY_PIN_11 GPIO_Pin_7
+#define TKEY_PIN_12 GPIO_Pin_8
+#define TKEY_PIN_13 GPIO_Pin_9
+
+#define KEYCODE_CONSUMER 0x8000
+#define CONSUMER(usage) (KEYCODE_CONSUMER | (usage))
+
+#define TKEY_PIN(ch) TKEY_PIN_(ch)
+#define TKEY_PIN_(ch) TKEY_PIN_##ch
+
+// --- Expansions ---
+
+#define KEYDEF_CH(name, ch, code)       ch,
+#define KEYDEF_CODE(name, ch, code)     code,
+#define KEYDEF_PIN(name, ch, code)      TKEY_PIN_##ch |
+#define KEYDEF_INDEX(name, ch, code)    KEY_##name,
+#define KEYDEF_CHECK(name, ch, code) \
+    _Static_assert((ch) <= 13, "KEY " #name ": TouchKey channel out of range"); \
+    _Static_assert(((code) & KEYCODE_CONSUMER) || (code) <= KEYBOARD_USAGE_MAX, "KEY " #name ": keycode outside the report descriptor usage range");
+
+// Key indices in scan order: KEY_LEFT, KEY_UP, ...
+enum { KEYBOARD_KEYS(KEYDEF_INDEX) KEYBOARD_NUM_KEYS };
+
+// Pins to configure as floating inputs for the touch pads
+#ifdef KEYBOARD_GUARD_CH
+#define KEYBOARD_GPIO_MASK (KEYBOARD_KEYS(KEYDEF_PIN) TKEY_PIN(KEYBOARD_GUARD_CH))
+#else
+#define KEYBOARD_GPIO_MASK (KEYBOARD_KEYS(KEYDEF_PIN) 0)
+#endif
+
+// Highest keycode the report descriptor declares (Usage Maximum / Logical Maximum)
+#define KEYBOARD_USAGE_MAX 0x65
+
+KEYBOARD_KEYS(KEYDEF_CHECK)
+
+#endif
@@ -7,46 +7,56 @@
 #include "usb_defs.h"
 #include "usb_descriptors.h"
 
+// NOTE: Report builder/queue shared by the USB and BLE transports
+#include "hid_report.h"
+#include "ble_hid.h"
 
+// NOTE: USB device core (EP0 requests, EP1 reports, enumeration trace)
+#include "usb_device.h"
 
-// --- Global Variables (Adapted for CH582M) ---
-// Extern declarations for USB DMA pointers (see SDK's CH58x_usbdev.c/.h)
+// NOTE: TouchKey configuration/state, whole-sweep classifier (water film,
+// guard pad, proximity), fixed-rate scan clock, channel health/error counters,
+// touch event stream + gesture recogniser and the UART command console
+#include "touch.h"
+#include "touch_frame.h"
+#include "scan_clock.h"
+#include "health.h"
+#include "touch_event.h"
+#include "gesture.h"
+#include "console.h"
 
+// NOTE: In-application firmware update state machine
+#include "dfu.h"
 
-uint8_t DevConfig, Ready;
-uint8_t SetupReqCode;
-uint16_t SetupReqLen;
-const uint8_t *pDescr;
+// NOTE: Watchdog progress bits and the retained-RAM warm restart
+#include "recovery.h"
 
-// EP0 setup packet buffer (Needed as pSetupReqPak is usually an alias to this)
-__attribute__((aligned(4))) uint8_t UsbSetupBuf[8];
-#define pSetupReqPak ((USB_SETUP_REQ *)UsbSetupBuf)
+// NOTE: Low/high system clock selection by activity, time-at-frequency counters
+#include "clock_policy.h"
 
-// User-allocated RAM
-__attribute__((aligned(4)))  uint8_t EP0_Databuf[64];
-__attribute__((aligned(4)))  uint8_t EP1_Databuf[64 + 64];
 
-#define EP1_TX_Buf (EP1_Databuf + 64)  // TX buffer for EP1 is at offset +64 (IN buffer)
 
 // --- Helper Functions and Macros ---
 
 // Define the LED pin as PB4
 #define LED_PIN GPIO_Pin_4
 
+// DEBUG_MODE: interval of the per-key Base/Current/Diff dump
+#define DEBUG_KEYS_MS 500
+
 
 // --- Your Original Variables ---
-#define TOUCH_THRES 140
-#define TOUCH_BASE_SAMPLES 8
-const uint8_t tkey_ch[] = { 5, 2, 4 };
-const uint8_t key_map[] = { 0x50, 0x52, 0x4F }; // A, B, C
-#define NUM_KEYS (sizeof(tkey_ch)/sizeof(tkey_ch[0]))
-uint16_t base_cal[NUM_KEYS] = {0};
-uint8_t KeyBuf[8] = {0, 0, 0, 0, 0, 0, 0, 0}; // Working buffer for keyboard data - fully initialized
+// NOTE: Touch thresholds, keymap and baselines now live in touch.h
+uint8_t KeyBuf[HID_REPORT_MAX]; // Working buffer for one packed report
+
+#define TKEY_TIMEOUT 10000  // EOC poll iterations (~1 ms at 60 MHz), a conversion takes a few us
 
 /**
  * Direct Register Implementation of Touch Reading
+ * Returns 0 if the conversion never completes, which health.h reports as a rail fault.
  */
 uint16_t TouchKey_Get(uint8_t ch) {
+    uint32_t n = TKEY_TIMEOUT;
     // 1. Select the ADC channel (TouchKey pins are shared with ADC channels)
     R8_ADC_CHANNEL = (ch & RB_ADC_CH_INX);
     // 2. Ensure TouchKey power is ON
@@ -54,207 +64,384 @@ uint16_t TouchKey_Get(uint8_t ch) {
     // 3. Start the TouchKey conversion
     R8_TKEY_CONVERT = RB_TKEY_START;
     // 4. Wait for completion flag
-    while (!(R8_ADC_INT_FLAG & RB_ADC_IF_EOC));
+    while (!(R8_ADC_INT_FLAG & RB_ADC_IF_EOC)) {
+        if (--n == 0) {
+            HwPollTimeouts++;
+            return 0;
+        }
+    }
     // 5. Return the result
     return (R16_ADC_DATA & RB_ADC_DATA);
 }
 
+#ifdef CONFIG_BLE_HID
+const HidTransport *hid_tx = &ble_hid_transport;
+#else
+const HidTransport *hid_tx = &usb_hid_transport;
+#endif
+
+// Last report queued per channel; only reports that differ get queued
+HidReport hid_sent_keys;
+HidReport hid_sent_consumer;
+
+/**
+ * Pack the key state in the layout of the active protocol and queue what changed.
+ * Returns 0 if the queue was full; call again on the next frame.
+ */
+uint8_t Hid_ReportKeys(const uint8_t *codes, uint8_t n, uint16_t consumer) {
+    uint8_t boot = (UsbProtocol == 0);
+    uint8_t ok = HidQueue_PushChanged(&hid_q, &hid_sent_keys, HID_CH_KEYBOARD, KeyBuf, Report_PackKeys(KeyBuf, boot, 0, codes, n));
+#ifdef CONFIG_HID_CONSUMER
+    if (!boot) ok &= HidQueue_PushChanged(&hid_q, &hid_sent_consumer, HID_CH_CONSUMER, KeyBuf, Report_PackConsumer(KeyBuf, consumer));
+#else
+    (void)consumer;
+#endif
+    return ok;
+}
+
+#define HID_TAP_SLOTS 2 // Queue entries a tap needs: press and release
+
+/**
+ * Press and release one code (keyboard usage or CONSUMER(usage)), for gestures.
+ * Returns 0 if either report did not fit; re-sending the current key state
+ * (report_pending in the main loop) then releases the key.
+ */
+uint8_t Hid_Tap(uint16_t code) {
+    uint8_t kc = code, ok;
+    if (code & KEYCODE_CONSUMER) ok = Hid_ReportKeys(NULL, 0, code & ~KEYCODE_CONSUMER);
+    else ok = Hid_ReportKeys(&kc, 1, 0);
+    return Hid_ReportKeys(NULL, 0, 0) && ok;
+}
+
 /**
- * USB Endpoint 1 Transmit
+ * Is there a host that should be taking reports? (not while unplugged,
+ * disconnected or suspended, the queue is allowed to stall then)
  */
-void DevEP1_IN_Transmit(uint16_t len) {
-    R8_UEP1_T_LEN = len;
-    // Clear response mask and set to ACK
-    R8_UEP1_CTRL = (R8_UEP1_CTRL & ~UEP_T_RES_MASK) | UEP_T_RES_ACK;
+uint8_t Hid_HostPresent(void) {
+#ifdef CONFIG_BLE_HID
+    return ble_hid_connected;
+#else
+    return UsbState == USB_STATE_CONFIGURED;
+#endif
 }
 
 
 // ====================================================================
-// === CORE USB ENUMERATION HANDLER (USB_DevTransProcess) ===
+// === FIRMWARE UPDATE GLUE (see dfu.h) ===
 // ====================================================================
 
-void USB_DevTransProcess( void )
-{
-    uint8_t len, chtype;
-    uint8_t intflag, errflag = 0;
-
-    intflag = R8_USB_INT_FG;
-    if ( intflag & RB_UIF_TRANSFER )
-    {
-        if ( ( R8_USB_INT_ST & MASK_UIS_TOKEN ) != MASK_UIS_TOKEN ) // Not an idle/SETUP state
-        {
-            switch ( R8_USB_INT_ST & ( MASK_UIS_TOKEN | MASK_UIS_ENDP ) )
-            {
-                // --- IN Token (Host is ready to receive data) ---
-                case UIS_TOKEN_IN | 0: // Endpoint 0 IN
-                    switch ( SetupReqCode )
-                    {
-                        case USB_GET_DESCRIPTOR:
-                            len = SetupReqLen >= DevEP0SIZE ? DevEP0SIZE : SetupReqLen;
-                            memcpy( pEP0_RAM_Addr, pDescr, len ); /* Load upload data */
-                            SetupReqLen -= len;
-                            pDescr += len;
-                            R8_UEP0_T_LEN = len;
-                            R8_UEP0_CTRL ^= RB_UEP_T_TOG; // Toggle PID
-                            break;
-                        case USB_SET_ADDRESS:
-                            R8_USB_DEV_AD = ( R8_USB_DEV_AD & RB_UDA_GP_BIT ) | SetupReqLen;
-                            R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
-                            break;
-                        default:
-                            R8_UEP0_T_LEN = 0;
-                            R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
-                            break;
-                    }
-                    break;
-
-                case UIS_TOKEN_OUT | 0: // Endpoint 0 OUT (Status stage)
-                    // The joystick example had LED control here, but for now we just ACK/NAK status
-                    R8_UEP0_T_LEN = 0;
-                    R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
-                    break;
-
-                // --- Your Keyboard Endpoint ---
-                case UIS_TOKEN_IN | 1 : // Endpoint 1 IN
-                    // Toggle the PID and set back to NAK after sending one packet
-                    // --- FIX 2: Do NOT manually toggle if AUTO_TOG is enabled ---
-                    // R8_UEP1_CTRL ^= RB_UEP_T_TOG;  <-- DELETE THIS LINE
-
-                    // Just set it to NAK (and preserve the AUTO_TOG bit)
-                    R8_UEP1_CTRL = ( R8_UEP1_CTRL & ~UEP_T_RES_MASK ) | UEP_T_RES_NAK;
-                    break;
-                // No need for Endpoint 1 OUT (unless you want LED feedback)
+#define DFU_FLAG_ADDR 0  // DataFlash offset of the pending-swap record
+
+DfuCtx dfu;
+volatile uint8_t dfu_status_held;   // EP0 status stage NAKed until a page buffer frees up
+volatile uint8_t dfu_reboot_req;
+
+int DfuFlash_Erase(uint32_t addr, uint32_t len) {
+    return FLASH_ROM_ERASE(addr, len);
+}
+
+int DfuFlash_Program(uint32_t addr, const uint8_t *buf, uint32_t len) {
+    return FLASH_ROM_WRITE(addr, (void *)buf, len);
+}
+
+int DfuFlash_Read(uint32_t addr, uint8_t *buf, uint32_t len) {
+    // CodeFlash is memory mapped from address 0
+    memcpy(buf, (const void *)addr, len);
+    return 0;
+}
+
+int DfuFlash_SetPending(const DfuImageInfo *info) {
+    if (EEPROM_ERASE(DFU_FLAG_ADDR, EEPROM_PAGE_SIZE)) return -1;
+    return EEPROM_WRITE(DFU_FLAG_ADDR, (void *)info, sizeof(*info));
+}
+
+const DfuFlashOps dfu_flash_ops = {
+    DfuFlash_Erase, DfuFlash_Program, DfuFlash_Read, DfuFlash_SetPending
+};
+
+// Boot-time swap helpers. Everything the swap calls must be in RAM: the ISP
+// library is placed in .highcode by Link.ld, the rest is below.
+
+/**
+ * CRC32 of CodeFlash [addr, addr+len), bitwise so it needs no table in flash.
+ */
+__HIGH_CODE
+uint32_t DfuBoot_Crc32(uint32_t addr, uint32_t len) {
+    const volatile uint8_t *p = (const volatile uint8_t *)addr;
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--) {
+        crc ^= *p++;
+        for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+#define DFU_SWAP_TRIES 3
+
+/**
+ * Swap a staged image into place. Call first thing after reset (boot main()).
+ * NOTE: Runs from RAM (__HIGH_CODE) because the application region is rewritten
+ * underneath it; nothing in the old image (memcpy, SYS_ResetExecute, the CRC
+ * table) may be called, hence no loop-to-memcpy transformation either.
+ *
+ * Power-fail safety: the pending record is only cleared once the copy has been
+ * read back and matches the image CRC, so an interrupted swap starts over on the
+ * next boot. Sectors are rewritten top-down and Link.ld keeps the boot path
+ * (reset code, main(), the .highcode and .data load images the startup code
+ * copies before main()) at the start of CodeFlash, so it is rewritten last. The one remaining window is the rewrite of those first
+ * sectors (a few ms); a board that dies there is recovered through the ROM
+ * bootloader (wchisp), the same as a blank chip.
+ */
+__HIGH_CODE __attribute__((optimize("no-tree-loop-distribute-patterns")))
+void Dfu_ApplyPending(void) {
+    DfuImageInfo info;
+    __attribute__((aligned(4))) uint32_t page[DFU_PAGE_SIZE / 4];
+    uint32_t top, addr, off;
+
+    EEPROM_READ(DFU_FLAG_ADDR, &info, sizeof(info));
+    if (info.magic != DFU_MAGIC || info.size == 0 || info.size > DFU_SLOT_SIZE) return;
+
+    // A slot that does not match cannot be swapped in; drop the record so it never loops
+    if (DfuBoot_Crc32(DFU_SLOT_ADDR, info.size) != info.crc) {
+        EEPROM_ERASE(DFU_FLAG_ADDR, EEPROM_PAGE_SIZE);
+        return;
+    }
+
+    // Watchdog off (inlined WWDG_ResetCfg), the copy takes several seconds
+    R8_SAFE_ACCESS_SIG = SAFE_ACCESS_SIG1;
+    R8_SAFE_ACCESS_SIG = SAFE_ACCESS_SIG2;
+    R8_RST_WDOG_CTRL &= ~RB_WDOG_RST_EN;
+    R8_SAFE_ACCESS_SIG = 0;
+
+    top = (info.size + DFU_SECTOR_SIZE - 1) & ~(DFU_SECTOR_SIZE - 1);
+    for (int tries = 0; tries < DFU_SWAP_TRIES; tries++) {
+        for (addr = top; addr > 0; ) {
+            addr -= DFU_SECTOR_SIZE;
+            FLASH_ROM_ERASE(addr, DFU_SECTOR_SIZE);
+            for (off = 0; off < DFU_SECTOR_SIZE; off += DFU_PAGE_SIZE) {
+                const volatile uint32_t *src = (const volatile uint32_t *)(DFU_SLOT_ADDR + addr + off);
+                for (int w = 0; w < DFU_PAGE_SIZE / 4; w++) page[w] = src[w];
+                FLASH_ROM_WRITE(addr + off, page, DFU_PAGE_SIZE);
             }
-            R8_USB_INT_FG = RB_UIF_TRANSFER; // Clear Interrupt Flag
         }
+        if (DfuBoot_Crc32(0, info.size) == info.crc) {
+            EEPROM_ERASE(DFU_FLAG_ADDR, EEPROM_PAGE_SIZE);
+            break;
+        }
+    }
+    // Still pending if every try failed to read back: the next boot tries again
 
-        // --- SETUP Transaction on Endpoint 0 ---
-        if ( R8_USB_INT_ST & RB_UIS_SETUP_ACT )
-        {
-            // Set EP0 to ACK both IN/OUT, and set PID to DATA1 for the next transfer
-            R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_NAK;
-
-            // Copy setup packet from hardware buffer to UsbSetupBuf (pEP0_RAM_Addr is often mapped to UsbSetupBuf)
-            memcpy(UsbSetupBuf, pEP0_RAM_Addr, 8);
-
-            SetupReqLen = pSetupReqPak->wLength;
-            SetupReqCode = pSetupReqPak->bRequest;
-            chtype = pSetupReqPak->bRequestType;
-
-            len = 0;
-            errflag = 0;
-
-            if ( ( chtype & USB_REQ_TYP_MASK ) == USB_REQ_TYP_STANDARD )
-            {
-                switch ( SetupReqCode )
-                {
-                    case USB_GET_DESCRIPTOR :
-                    {
-                        switch ( ( ( pSetupReqPak->wValue ) >> 8 ) )
-                        {
-                            case USB_DESCR_TYP_DEVICE : // Device
-                                pDescr = MyDevDescr;
-                                len = MyDevDescr[0];
-                                break;
-                            case USB_DESCR_TYP_CONFIG : // Configuration
-                                pDescr = MyCfgDescr;
-                                len = MyCfgDescr[2] + (MyCfgDescr[3] << 8); // Total length
-                                break;
-                            case USB_DESCR_TYP_REPORT : // HID Report
-                                if ( ( ( pSetupReqPak->wIndex ) & 0xff ) == 0 ) // Interface 0 report
-                                {
-                                    pDescr = MyHIDReportDescr;
-                                    len = sizeof( MyHIDReportDescr );
-                                }
-                                break;
-                            case USB_DESCR_TYP_STRING : // String
-                            {
-                                switch ( ( pSetupReqPak->wValue ) & 0xff )
-                                {
-                                    case 1 : pDescr = MyManuInfo; len = MyManuInfo[0]; break;
-                                    case 2 : pDescr = MyProdInfo; len = MyProdInfo[0]; break;
-                                    case 0 : pDescr = MyLangDescr; len = MyLangDescr[0]; break;
-                                    default : errflag = 0xFF; break;
-                                }
-                            }
-                            break;
-                            default :
-                                errflag = 0xff;
-                                break;
-                        }
-                        if ( SetupReqLen > len ) SetupReqLen = len; // Cap requested length
-                        len = ( SetupReqLen >= DevEP0SIZE ) ? DevEP0SIZE : SetupReqLen;
-                        memcpy( pEP0_RAM_Addr, pDescr, len );
-                        pDescr += len;
-                    }
-                    break;
-                    case USB_SET_ADDRESS :
-                        SetupReqLen = ( pSetupReqPak->wValue ) & 0xff;
-                        break;
-                    case USB_SET_CONFIGURATION :
-                        DevConfig = ( pSetupReqPak->wValue ) & 0xff;
-                        R8_UEP1_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK | RB_UEP_AUTO_TOG; // Set EP1 for data transfer
-                        break;
-                    case USB_CLEAR_FEATURE :
-                        // Endpoint 1 stall clear (required for robust USB)
-                        if ( ( (pSetupReqPak->wIndex) & 0xff ) == 0x81 )
-                            R8_UEP1_CTRL = ( R8_UEP1_CTRL & ~( RB_UEP_T_TOG | MASK_UEP_T_RES ) ) | UEP_T_RES_NAK;
-                        break;
-                    case USB_GET_INTERFACE :
-                    case USB_GET_STATUS :
-                    case USB_GET_CONFIGURATION :
-                        // Simple requests are handled implicitly or with a short response
-                        len = 0;
-                        break;
-                    default :
-                        errflag = 0xff;
-                        break;
-                }
-            } else if ( ( chtype & USB_REQ_TYP_MASK ) == USB_REQ_TYP_CLASS ) {
-                // HID Class requests (SET_IDLE, GET_REPORT, etc.)
-                // The joystick sample's `case 0x09` and `case 0x0a` cover SET_REPORT/GET_REPORT (0x01) and SET_IDLE/GET_IDLE (0x0A) implicitly
-                // For a simple HID, we can often just ACK these.
-                len = 0;
-            }
+    // Software reset (inlined, SYS_ResetExecute lived in the old image)
+    R8_SAFE_ACCESS_SIG = SAFE_ACCESS_SIG1;
+    R8_SAFE_ACCESS_SIG = SAFE_ACCESS_SIG2;
+    R8_RST_WDOG_CTRL |= RB_SOFTWARE_RESET;
+    while (1);
+}
 
-            if ( errflag == 0xff )
-            {
-                R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_STALL | UEP_T_RES_STALL; // STALL
-            }
-            else
-            {
-                // Prepare for the data stage (send data if IN request)
-                if ( chtype & 0x80 ) len = ( SetupReqLen > DevEP0SIZE ) ? DevEP0SIZE : SetupReqLen;
-                else len = 0; // OUT request (Status stage)
-
-                R8_UEP0_T_LEN = len;
-                R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_ACK;
-            }
+/**
+ * Vendor SETUP stage (ISR context, hook from usb_device.h)
+ */
+uint8_t USB_VendorSetup(void) {
+    switch (SetupReqCode) {
+        case DFU_REQ_START:
+        case DFU_REQ_DATA:
+            return 0; // Payload is handled in the OUT data stage
+        case DFU_REQ_STATUS:
+            return Dfu_GetStatus(&dfu, UsbReplyBuf);
+        case DFU_REQ_REBOOT:
+            dfu_reboot_req = 1;
+            return 0;
+        case DFU_REQ_ABORT:
+            Dfu_PostAbort(&dfu);
+            return 0;
+        case HEALTH_REQ_GET:
+            return Health_GetBlock(UsbReplyBuf);
+        default:
+            return USB_VENDOR_STALL;
+    }
+}
 
-            R8_USB_INT_FG = RB_UIF_TRANSFER;
-        }
+/**
+ * EP0 OUT data stage of a DFU vendor request (ISR context, hook from usb_device.h)
+ */
+void USB_VendorOut(uint8_t len) {
+    DfuStatus st = DFU_ERR_STATE;
+    uint32_t size, crc;
+
+    if (SetupReqCode == DFU_REQ_START && len == 8) {
+        memcpy(&size, pEP0_RAM_Addr, 4);
+        memcpy(&crc, pEP0_RAM_Addr + 4, 4);
+        st = Dfu_PostStart(&dfu, size, crc);
+    } else if (SetupReqCode == DFU_REQ_DATA) {
+        st = Dfu_Write(&dfu, pSetupReqPak->wValue, pEP0_RAM_Addr, len);
     }
-    // --- Bus Reset (Re-initialization) ---
-    else if ( intflag & RB_UIF_BUS_RST )
-    {
-        R8_USB_DEV_AD = 0;
-        // Reset all endpoints to ACK/NAK
-        R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
-        R8_UEP1_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK | RB_UEP_AUTO_TOG;
-        R8_USB_INT_FG = RB_UIF_BUS_RST;
+
+    // Status stage: ACK, hold off (NAK) until the main loop has taken a START
+    // or a page buffer frees up, or STALL on error
+    R8_UEP0_T_LEN = 0;
+    if (st != DFU_OK) {
+        R8_UEP0_CTRL = UEP_R_RES_STALL | UEP_T_RES_STALL;
+    } else if (Dfu_PostPending(&dfu) || !Dfu_CanAccept(&dfu)) {
+        dfu_status_held = 1;
+        R8_UEP0_CTRL = RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_NAK;
+    } else {
+        R8_UEP0_CTRL = RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_ACK;
     }
-    // --- Suspend ---
-    else if ( intflag & RB_UIF_SUSPEND )
-    {
-        // Handle suspend/resume (optional)
-        R8_USB_INT_FG = RB_UIF_SUSPEND;
+}
+
+/**
+ * Main loop side: erase/program/verify and release a held status stage
+ */
+void Dfu_Service(void) {
+    if (Dfu_Process(&dfu) && dfu_status_held && !Dfu_PostPending(&dfu) && Dfu_CanAccept(&dfu)) {
+        dfu_status_held = 0;
+        R8_UEP0_CTRL = (R8_UEP0_CTRL & ~MASK_UEP_T_RES) | UEP_T_RES_ACK;
     }
-    else
-    {
-        R8_USB_INT_FG = intflag; // Clear any other flags
+    if (dfu_reboot_req) {
+        mDelaymS(10); // Let the status stage of the reboot request complete
+        SYS_ResetExecute();
     }
 }
 
+// ====================================================================
+// === SCAN TIMER (see scan_clock.h) ===
+// ====================================================================
+
+/**
+ * (Re)start TMR0 at a scan rate, derived from the current system clock
+ */
+void ScanTimer_SetRate(uint16_t hz) {
+    uint32_t clk = GetSysClock();
+
+    PFIC_DisableIRQ(TMR0_IRQn);
+    ScanClock_Configure(&scan_clk, clk, hz);
+    TMR0_TimerInit(scan_clk.period);
+    TMR0_ClearITFlag(TMR0_3_IT_CYC_END);
+    TMR0_ITCfg(ENABLE, TMR0_3_IT_CYC_END);
+    PFIC_EnableIRQ(TMR0_IRQn);
+}
+
+// Global interrupt enable (mstatus.MIE) only, for the take/sleep window of the
+// main loop. NOTE: not SYS_DisableAllIrq(): that masks every source at the PFIC,
+// and WFI only wakes on a pending source that is enabled there. With MIE clear a
+// pending TMR0/USB interrupt still ends the WFI and is taken on Irq_On().
+#define Irq_Off() __asm__ volatile("csrc mstatus, 8" ::: "memory")
+#define Irq_On()  __asm__ volatile("csrs mstatus, 8" ::: "memory")
+
+/**
+ * Stop the scan timer (the TouchKey block is then free for calibration)
+ */
+void ScanTimer_Stop(void) {
+    PFIC_DisableIRQ(TMR0_IRQn);
+    TMR0_Disable();
+    TMR0_ClearITFlag(TMR0_3_IT_CYC_END);
+}
+
+// ====================================================================
+// === WATCHDOG (see recovery.h) ===
+// ====================================================================
+
+// The WWDG counts up at Fsys/131072 and resets on overflow from 0xFF:
+// ~560 ms at 60 MHz, ~1.4 s at the low clock. Nothing in the main loop may
+// block longer than that, the slowest scan rate (10 Hz) leaves enough margin.
+
+void Watchdog_Start(void) {
+    WWDG_SetCounter(0);
+    WWDG_ResetCfg(ENABLE);
+}
+
+/**
+ * Kick the watchdog if every subsystem made progress, mirroring the state into
+ * retained RAM at the same time
+ */
+void Watchdog_Service(void) {
+    if (Progress_Complete()) {
+        Retained_Save();
+        WWDG_SetCounter(0);
+    }
+}
+
+// ====================================================================
+// === SYSTEM CLOCK (see clock_policy.h) ===
+// ====================================================================
+
+// Both levels keep the PLL up, the USB PHY clock derives from it
+const SYS_CLKTypeDef clock_src[CLOCK_LEVELS] = {
+    CLK_SOURCE_PLL_24MHz,   // CLOCK_LOW: idle and USB suspend
+    CLK_SOURCE_PLL_60MHz    // CLOCK_HIGH
+};
+
+/**
+ * Switch the system clock, re-deriving the UART baud rate and the scan timer period
+ */
+void Clock_Apply(uint8_t level) {
+    Debug_Drain(); // A byte in flight would go out at the wrong baud rate
+    SetSysClock(clock_src[level]);
+    UART1_BaudRateCfg(115200);
+    if (scan_clk.hz) ScanTimer_SetRate(scan_clk.hz);
+    ClockPolicy_Switched(&clock_pol, level, GetSysClock() / 1000000, scan_clk.t_us);
+}
+
+// ====================================================================
+// === SUSPEND / REMOTE WAKEUP ===
+// ====================================================================
+
+#define USB_SUSPEND_SCAN_HZ 50
+
+#define USB_WAKEUP_K_MS 5 // K state length, well inside the 1..15 ms window
+
+/**
+ * Signal remote wakeup (K state) on the bus.
+ * Spec: only after >= 5 ms of bus idle (guaranteed, we are at least one suspend
+ * scan period into suspend), K state held 1..15 ms; the host then drives resume.
+ * NOTE: timed on the SysTick counter at the system clock running now (the low
+ * clock while suspended). mDelaymS() counts loops for FREQ_SYS, so its length
+ * changes with the clock policy.
+ */
+void USB_RemoteWakeup(void) {
+    uint32_t ctlr = SysTick->CTLR;
+    uint64_t ticks = (uint64_t)(GetSysClock() / 1000) * USB_WAKEUP_K_MS;
+    uint64_t start;
+
+    SysTick->CTLR = SysTick_CTLR_STCLK | SysTick_CTLR_STE; // Count up at HCLK, no interrupt
+    start = SysTick->CNT;
+    R16_PIN_ANALOG_IE &= ~RB_PIN_USB_DP_PU;
+    R8_UDEV_CTRL |= RB_UD_LOW_SPEED;
+    while (SysTick->CNT - start < ticks) {}
+    R8_UDEV_CTRL &= ~RB_UD_LOW_SPEED;
+    R16_PIN_ANALOG_IE |= RB_PIN_USB_DP_PU;
+    SysTick->CTLR = ctlr;
+}
+
+// ====================================================================
+// === CONSOLE UART (see console.h) ===
+// ====================================================================
+
+/**
+ * Receive interrupts on UART1: FIFO trigger level and RX timeout (a partial FIFO
+ * that has gone quiet), so no byte waits for the next scan
+ */
+void Console_UartInit(void) {
+    UART1_INTCfg(ENABLE, RB_IER_RECV_RDY | RB_IER_LINE_STAT);
+    PFIC_EnableIRQ(UART1_IRQn);
+}
+
+__INTERRUPT
+__HIGH_CODE
+void UART1_IRQHandler(void) {
+    switch (UART1_GetITFlag()) {
+        case UART_II_RECV_RDY:
+        case UART_II_RECV_TOUT:
+            while (R8_UART1_RFC) Console_RxPush(R8_UART1_RBR);
+            break;
+        case UART_II_LINE_STAT:
+            (void)UART1_GetLinSTA(); // Reading LSR clears an overrun/framing error
+            break;
+        default:
+            break;
+    }
+}
 
 // ====================================================================
 // === INTERRUPT HANDLER (The function you originally called) ===
@@ -265,6 +452,7 @@ __INTERRUPT
 __HIGH_CODE
 void USB_IRQHandler(void) {
     USB_DevTransProcess();
+    clock_pol.usb_irq = 1;
 }
 
 
@@ -272,28 +460,133 @@ void USB_IRQHandler(void) {
 // === MAIN APPLICATION LOGIC (Your TouchKey Code) ===
 // ====================================================================
 
-void Touch_Setup() {
-    GPIOA_ModeCfg(GPIO_Pin_12 | GPIO_Pin_14 | GPIO_Pin_15, GPIO_ModeIN_Floating);
+// R8_TKEY_COUNT value per hop, derived from the SDK default in Touch_Setup()
+uint8_t touch_hop_reg[TOUCH_HOPS];
 
-    TouchKey_ChSampInit();
+void Touch_Calibrate() {
+    for(int k=0; k<NUM_KEYS; k++) {
+        for(int h=0; h<TOUCH_HOPS; h++) {
+            uint32_t sum = 0;
+            R8_TKEY_COUNT = touch_hop_reg[h];
+            for(int j=0; j<TOUCH_BASE_SAMPLES; j++) {
+                sum += TouchKey_Get(tkey_ch[k]);
+                mDelayuS(100);
+            }
+            touch_st.base_cal[k][h] = sum / TOUCH_BASE_SAMPLES;
+            touch_st.noise[k][h] = 0;
+        }
+        touch_st.pressed[k] = 0;
+        touch_st.count[k] = 0;
+    }
+#ifdef KEYBOARD_GUARD_CH
+    uint32_t sum = 0;
+    R8_TKEY_COUNT = touch_hop_reg[0];
+    for(int j=0; j<TOUCH_BASE_SAMPLES; j++) {
+        sum += TouchKey_Get(KEYBOARD_GUARD_CH);
+        mDelayuS(100);
+    }
+    touch_st.guard_base = sum / TOUCH_BASE_SAMPLES;
+#endif
+}
 
-    // Initial Calibration
-    mDelaymS(100);
+/**
+ * Convert every key once per hop into a frame (scan timer ISR context)
+ */
+void Touch_Acquire(ScanFrame *f) {
     for(int k=0; k<NUM_KEYS; k++) {
-        uint32_t sum = 0;
-        for(int j=0; j<TOUCH_BASE_SAMPLES; j++) {
-            sum += TouchKey_Get(tkey_ch[k]);
-            mDelayuS(100);
+        for(int h=0; h<TOUCH_HOPS; h++) {
+            R8_TKEY_COUNT = touch_hop_reg[h];
+            f->raw[k][h] = TouchKey_Get(tkey_ch[k]);
         }
-        base_cal[k] = sum / TOUCH_BASE_SAMPLES;
     }
+#ifdef KEYBOARD_GUARD_CH
+    R8_TKEY_COUNT = touch_hop_reg[0];
+    f->guard_raw = TouchKey_Get(KEYBOARD_GUARD_CH);
+#endif
 }
 
-int main() {
-    // Set system clock
-    SetSysClock(CLK_SOURCE_PLL_60MHz);
+/**
+ * Take over an acquired frame and leave the median delta per key in touch_st.delta[]
+ */
+void Touch_Process(const ScanFrame *f) {
+    memcpy(touch_st.raw, f->raw, sizeof(touch_st.raw));
+    touch_st.t_us = f->t_us;
+#ifdef KEYBOARD_GUARD_CH
+    touch_st.guard_delta = touch_st.guard_base - f->guard_raw;
+#endif
+    for(int k=0; k<NUM_KEYS; k++) {
+        Touch_HopCombine(k);
+    }
+}
+
+/**
+ * Scan timer: one sweep per period, timestamped against the period boundary
+ */
+__INTERRUPT
+__HIGH_CODE
+void TMR0_IRQHandler(void) {
+    uint32_t t0 = TMR0_GetCurrentCount();
+    uint32_t t1;
+
+    TMR0_ClearITFlag(TMR0_3_IT_CYC_END);
+    Touch_Acquire(ScanClock_WriteBuf(&scan_clk));
+    Progress_Mark(PROGRESS_SCAN);
+    t1 = TMR0_GetCurrentCount();
+    // A sweep longer than the period wraps the counter (and delays the next entry)
+    ScanClock_Publish(&scan_clk, t0, (t1 >= t0) ? t1 - t0 : t1 + scan_clk.period - t0);
+}
+
+/**
+ * Classify the sweep just taken. Returns 1 if keys must be suppressed.
+ */
+uint8_t Touch_Classify() {
+#ifdef KEYBOARD_GUARD_CH
+    int16_t guard = touch_st.guard_delta;
+#else
+    int16_t guard = 0;
+#endif
+    return Touch_FrameUpdate(Touch_ClassifyFrame(touch_st.delta, touch_cfg.thres, NUM_KEYS, guard));
+}
+
+/**
+ * Returns 1 on a warm start (baselines and tuning restored after a watchdog reset)
+ */
+uint8_t Touch_Setup() {
+    GPIOA_ModeCfg(KEYBOARD_GPIO_MASK, GPIO_ModeIN_Floating);
+
+    TouchKey_ChSampInit();
+
+    // Hop 0 is the SDK default charge count, the others step below/above it.
+    // Only the charge count (bits 0..4) hops, the discharge count stays as set up.
+    for(int h=0; h<TOUCH_HOPS; h++) {
+        int cnt = (R8_TKEY_COUNT & RB_TKEY_CHARG_CNT) + ((h + 1) / 2) * ((h & 1) ? -TOUCH_HOP_STEP : TOUCH_HOP_STEP);
+        if (cnt < 1) cnt = 1;
+        if (cnt > RB_TKEY_CHARG_CNT) cnt = RB_TKEY_CHARG_CNT;
+        touch_hop_reg[h] = (R8_TKEY_COUNT & RB_TKEY_DISCH_CNT) | cnt;
+    }
+
+    // After a watchdog reset carry on with the retained baselines, no settle/calibration
+    if (SYS_GetLastResetSta() == RST_STATUS_WTR && Retained_Restore()) return 1;
+
+    // Initial Calibration
+    TouchCfg_Defaults();
+    mDelaymS(100);
+    Touch_Calibrate();
+    return 0;
+}
+
+int App_Main(void) {
+    uint8_t warm;
+
+    // Set system clock; the loop drops it once idle
+    SetSysClock(clock_src[CLOCK_HIGH]);
+    ClockPolicy_Init(&clock_pol, CLOCK_HIGH, GetSysClock() / 1000000, 0);
+    WWDG_ResetCfg(DISABLE); // Re-armed at the main loop, the boot path below may take long
+
+    Dfu_Init(&dfu, &dfu_flash_ops);
 
     DebugInit();
+    Console_UartInit();
 
     // LED Init
     GPIOB_ModeCfg(LED_PIN, GPIO_ModeOut_PP_5mA);
@@ -303,11 +596,17 @@ int main() {
     pEP1_RAM_Addr = EP1_Databuf;
 
     // Initialize USB hardware
+    USB_InitSerial();
     USB_DeviceInit();
 
     // Enable USB Interrupt
     PFIC_EnableIRQ(USB_IRQn);
 
+    #ifdef CONFIG_BLE_HID
+    // BLE stack, HOG profile and advertising (see ble_hid.h)
+    BleHid_Init();
+    #endif
+
     #ifdef DEBUG_MODE
     // Verify DMA pointers are set correctly
     printf("\n\n=== USB DMA POINTER VERIFICATION ===\n");
@@ -325,105 +624,219 @@ int main() {
     }
     #endif //DEBUG_MODE
 
-    Touch_Setup();
-
-    // Wait for USB enumeration to complete and send initial "all keys up" report
-    mDelaymS(500);
-    printf("\n=== USB ENUMERATION COMPLETE ===\n");
+    warm = Touch_Setup();
+
+    if (warm) {
+        // Watchdog reset: the host re-enumerates on its own, no need to wait for it
+        printf("\n=== WATCHDOG RESET #%lu, RESTORED (stalled 0x%02X) ===\n",
+            (unsigned long)health.wdt_resets, health.wdt_stalled);
+    } else {
+        // Wait for USB enumeration to complete and send initial "all keys up" report
+        mDelaymS(500);
+        printf("\n=== USB ENUMERATION COMPLETE ===\n");
+        #ifdef DEBUG_MODE
+        USB_TraceDump();
+        #endif //DEBUG_MODE
+    }
     printf("Sending initial 'all keys up' report...\n");
 
-    // Send initial empty report to clear any garbage state on host
-    memset(KeyBuf, 0, 8);
-    memcpy(EP1_TX_Buf, KeyBuf, 8);
-    R8_UEP1_T_LEN = 8;
-    R8_UEP1_CTRL = (R8_UEP1_CTRL & ~UEP_T_RES_MASK) | UEP_T_RES_ACK;
-    mDelaymS(20); // Give time for transmission
+    // Queue initial empty report to clear any garbage state on host
+    Hid_ReportKeys(NULL, 0, 0);
+    Hid_Flush(&hid_q, hid_tx);
+    if (!warm) mDelaymS(20); // Give time for transmission
 
     printf("Begin MainLoop\n\n");
+    retained.progress = 0;
+    Retained_Save();
+    ScanTimer_SetRate(touch_cfg.scan_hz);
+    Watchdog_Start();
+
+    while(1) {
+        uint16_t pressed_mask = 0;
+        uint8_t codes[NUM_KEYS], n_codes = 0;
+        uint16_t consumer = 0;
+        static uint16_t last_mask = 0;
+        static uint8_t last_protocol = 1;
+        static uint8_t report_pending = 0;
+        static uint8_t was_suspended = 0;
+        static uint8_t wakeup_sent = 0;
+        const ScanFrame *frame;
+
+        // Sleep until the scan timer publishes the next sweep. The report queue is
+        // drained on every wakeup and a running firmware update is serviced flat out.
+        // USB traffic at the low clock switches to the high one straight away.
+        // Interrupts are held off (Irq_Off) across the take and across the check
+        // before __WFI(): an interrupt that becomes pending in between still ends
+        // the WFI and runs on Irq_On(), so no frame is lost or slept through.
+        while (1) {
+            Irq_Off();
+            frame = ScanClock_Take(&scan_clk);
+            Irq_On();
+            if (frame) break;
+
+            if (ClockPolicy_Boost(&clock_pol, was_suspended)) Clock_Apply(CLOCK_HIGH);
+            #ifdef CONFIG_BLE_HID
+            BleHid_Process();
+            #endif
+            if (Hid_Flush(&hid_q, hid_tx)) Progress_Mark(PROGRESS_HID);
+            Dfu_Service();
+
+            Irq_Off();
+            if (!Dfu_Active(&dfu) && !scan_clk.ready) __WFI();
+            Irq_On();
+        }
 
-    int flag_did_trasmit = 0;
+        // Copy the frame out before anything slow (console, clock switch, recal):
+        // the ISR reuses its buffer two periods after it was published
+        Touch_Process(frame);
 
-        if (flag_did_trasmit){
-            #ifdef DEBUG_MODE
-            printf("\n\nUSB Transmitt occured!\n--------------------------------\n");
-            #endif //DEBUG_MODE
-            flag_did_trasmit = 0;
+        // Follow the bus into and out of suspend: low clock and slow scan rate while suspended
+        if ((UsbState == USB_STATE_SUSPENDED) != was_suspended) {
+            was_suspended = !was_suspended;
+            wakeup_sent = 0;
+            if (clock_pol.level != (was_suspended ? CLOCK_LOW : CLOCK_HIGH)) {
+                Clock_Apply(was_suspended ? CLOCK_LOW : CLOCK_HIGH);
+            }
         }
 
-        mDelaymS(10);
-    while(1) {
-        uint8_t current_pressed = 0;
-        static uint8_t last_pressed = 0;
+        // Apply pending console commands between scans
+        Console_Poll();
+        if (touch_cfg.recal_req) {
+            ScanTimer_Stop();
+            Touch_Calibrate();
+            ScanTimer_SetRate(scan_clk.hz);
+            touch_cfg.recal_req = 0;
+            printf("cal done\n");
+        }
 
+        // Water film / guard pad: every key reads as released for this sweep
+        uint8_t suppress = Touch_Classify();
+        uint32_t frame_us = 1000000UL / scan_clk.hz;
+        #ifdef DEBUG_MODE
+        // A line per key every sweep would outrun the UART at the scan rate
+        static uint32_t debug_keys_us;
+        uint8_t debug_keys = (touch_st.t_us - debug_keys_us >= DEBUG_KEYS_MS * 1000u);
+        if (debug_keys) debug_keys_us = touch_st.t_us;
+        #endif //DEBUG_MODE
         for(int i=0; i<NUM_KEYS; i++) {
-            uint16_t val = TouchKey_Get(tkey_ch[i]);
-
             #ifdef DEBUG_MODE
-            // Print the raw values for each channel
-            printf("CH%d -)) Base=[ %d ], Current=[ %d ], Diff=[ %d ]\n",
+            // Print the raw values for each channel (hop 0) and the combined delta
+            if (debug_keys) printf("CH%d -)) Base=[ %d ], Current=[ %d ], Diff=[ %d ]\n",
                 tkey_ch[i],
-                base_cal[i],
-                val,
-                (base_cal[i] - val));
+                touch_st.base_cal[i][0],
+                touch_st.raw[i][0],
+                touch_st.delta[i]);
             #endif //DEBUG_MODE
+            if (touch_cfg.trace) {
+                // Recorded-trace format for tools/false_trigger.py
+                printf("T,%lu,%d", (unsigned long)touch_st.scans, i);
+                for(int h=0; h<TOUCH_HOPS; h++) printf(",%d", touch_st.base_cal[i][h] - touch_st.raw[i][h]);
+                printf("\n");
+            }
 
-            if (val < (base_cal[i] - TOUCH_THRES)) {
-                current_pressed = key_map[i];
-                if (last_pressed == 0) {
-                    GPIOB_InverseBits(LED_PIN);
+            // Faulted channels read as released; a stuck key gets a new baseline
+            uint8_t was_pressed = touch_st.pressed[i];
+            uint8_t fault = Health_CheckKey(i, frame_us);
+
+            // Every channel is debounced; every pressed key is reported (unless
+            // the pads drive the gesture recogniser)
+            uint8_t pressed = Touch_Debounce(i, (suppress || fault) ? 0 : touch_st.delta[i]);
+            if (pressed != was_pressed) TouchEvent_Push(&touch_ev, touch_st.t_us, i, pressed);
+            if (pressed) {
+                uint16_t code = touch_cfg.key_map[i];
+                pressed_mask |= 1u << i;
+                if (!gesture.enabled) {
+                    if (!(code & KEYCODE_CONSUMER)) codes[n_codes++] = code;
+                    else if (consumer == 0) consumer = code & ~KEYCODE_CONSUMER;
+                }
+                if (was_suspended && UsbRemoteWakeupEn && !wakeup_sent) {
+                    // Touch while the host sleeps: wake it up once. The clock comes
+                    // back with the resume, the report stays queued until then.
+                    wakeup_sent = 1;
+                    USB_RemoteWakeup();
                 }
-                break; // Only register one key press at a time
             }
         }
+        touch_st.scans++;
+        if (pressed_mask && !last_mask) {
+            GPIOB_InverseBits(LED_PIN);
+        }
 
-        // HID Keyboard Logic: send key change immediately
-        if (current_pressed != last_pressed) {
-            #ifdef DEBUG_MODE
-            printf("\n=== KEY STATE CHANGE ===\n");
-            printf("Last: 0x%02X, Current: 0x%02X\n", last_pressed, current_pressed);
-            #endif //DEBUG_MODE
-
-            // Build report: NO MODIFIERS, reserved=0, keycode in slot 0 (KeyBuf[2])
-            // CRITICAL: Clear the entire buffer first to prevent garbage/ALT modifier issues
-            memset(KeyBuf, 0, 8);
+        // Event stream: recorded with "trace 1", recognised when gestures are on
+        TouchEvent ev;
+        Gesture ge;
+        while (TouchEvent_Pop(&touch_ev, &ev)) {
+            if (touch_cfg.trace) printf("E,%lu,%u,%u\n", (unsigned long)ev.t_us, ev.key, ev.down);
+            if (gesture.enabled) Gesture_Event(&gesture, &ev);
+        }
+        if (gesture.enabled) {
+            Gesture_Tick(&gesture, touch_st.t_us);
+            // Only take a gesture once its press and release both fit, so a full
+            // queue can never leave the key down; the rest wait in gesture.out
+            while (HidQueue_Free(&hid_q) >= HID_TAP_SLOTS && Gesture_Pop(&gesture, &ge)) {
+                #ifdef DEBUG_MODE
+                printf("Gesture %u key %u -> 0x%04X\n", ge.type, ge.key, Gesture_Code(&ge));
+                #endif //DEBUG_MODE
+                if (!Hid_Tap(Gesture_Code(&ge))) report_pending = 1;
+            }
+        }
 
-            KeyBuf[0] = 0;  // NO modifiers (bit 0=LCtrl, bit 1=LShift, bit 2=LAlt, bit 3=LGui, etc.)
-            KeyBuf[1] = 0;  // Reserved
-            KeyBuf[2] = current_pressed;  // First key slot (0 = no key pressed)
-            // Remaining slots already zeroed by memset
+        // SET_PROTOCOL switched the layout: send the current state in the new one
+        if (UsbProtocol != last_protocol) {
+            last_protocol = UsbProtocol;
+            hid_sent_keys.len = 0;
+            hid_sent_consumer.len = 0;
+            report_pending = 1;
+        }
 
+        // HID Keyboard Logic: pack only on a key change, queue only reports that differ
+        if (pressed_mask != last_mask || report_pending) {
             #ifdef DEBUG_MODE
-            printf("KeyBuf prepared: [%02X %02X %02X %02X %02X %02X %02X %02X]\n",
-                KeyBuf[0], KeyBuf[1], KeyBuf[2], KeyBuf[3],
-                KeyBuf[4], KeyBuf[5], KeyBuf[6], KeyBuf[7]);
+            printf("\n=== KEY STATE CHANGE ===\n");
+            printf("Last: 0x%04X, Current: 0x%04X\n", last_mask, pressed_mask);
             #endif //DEBUG_MODE
 
-            // Send when EP1 is ready (T endpoint result == NAK -> ready to load/send)
-            if ((R8_UEP1_CTRL & UEP_T_RES_MASK) == UEP_T_RES_NAK) {
-                // Copy to EP1_TX_Buf (which now correctly points to IN buffer at offset +64)
-                memcpy(EP1_TX_Buf, KeyBuf, 8);
-
-                DevEP1_IN_Transmit(8);
-                flag_did_trasmit = 1;
-
+            // Queue it; the active transport sends it as soon as it is ready
+            report_pending = !Hid_ReportKeys(codes, n_codes, consumer);
+            if (report_pending) {
                 #ifdef DEBUG_MODE
-                printf(">>> TRANSMISSION INITIATED <<<\n");
-                #endif //DEBUG_MODE
-            } else {
-                #ifdef DEBUG_MODE
-                printf("!!! EP1 NOT READY (not NAK) !!!\n");
+                printf("!!! REPORT QUEUE FULL, retrying next scan !!!\n");
                 #endif //DEBUG_MODE
             }
-            last_pressed = current_pressed;
+            last_mask = pressed_mask;
         }
 
-        if (flag_did_trasmit){
+        if (Hid_Flush(&hid_q, hid_tx)) {
+            Progress_Mark(PROGRESS_HID);
             #ifdef DEBUG_MODE
-            printf("\n\nUSB Transmitt occured!\n--------------------------------\n");
+            printf("\n\n%s Transmit occured!\n--------------------------------\n", hid_tx->name);
             #endif //DEBUG_MODE
-            flag_did_trasmit = 0;
         }
-
-        mDelaymS(10);
+        if (HidQueue_Empty(&hid_q) || !Hid_HostPresent()) Progress_Mark(PROGRESS_HID);
+        Progress_Mark(PROGRESS_LOOP);
+        Watchdog_Service();
+
+        // Slow idle rate until the frame classifier sees something near the panel
+        uint16_t hz = was_suspended ? USB_SUSPEND_SCAN_HZ :
+                      touch_frame.fast ? touch_cfg.scan_hz : FRAME_IDLE_SCAN_HZ;
+        if (hz != scan_clk.hz) ScanTimer_SetRate(hz);
+
+        // Low clock once nothing is going on (USB traffic is seen by the interrupt)
+        uint8_t busy = touch_frame.fast || report_pending || !HidQueue_Empty(&hid_q) || Dfu_Active(&dfu);
+        uint8_t level = ClockPolicy_Update(&clock_pol, touch_st.t_us, frame_us, busy, was_suspended);
+        if (level != clock_pol.level) Clock_Apply(level);
     }
 }
+
+/**
+ * Boot entry. Kept in .text.boot, which Link.ld places in the first CodeFlash
+ * sector next to the reset code, so a half-finished image swap still reaches
+ * Dfu_ApplyPending() (RAM) without touching the rest of the old image.
+ * It runs on the reset clock; App_Main() sets up the system clock.
+ */
+__attribute__((section(".text.boot")))
+int main() {
+    // Swap in a staged firmware image, if one is pending (does not return then)
+    Dfu_ApplyPending();
+    return App_Main();
+}
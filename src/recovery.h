@@ -0,0 +1,126 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include <stdint.h>
+#include "touch.h"
+#include "health.h"
+#include "hid_report.h"
+#include "usb_device.h"
+#include "scan_clock.h"
+#include "dfu.h"
+
+// --- Watchdog progress tracking and retained RAM ---
+//
+// Every subsystem sets its PROGRESS_* bit when it gets something done. The main
+// loop kicks the watchdog (main.c) only once all bits are set, so a subsystem
+// that stops moving resets the chip even if the loop itself still spins.
+//
+// Baselines, the runtime configuration, debounced key state and the error
+// counters are mirrored into a RAM block that the startup code does not clear.
+// After a watchdog reset with a valid block the device skips the settle delay,
+// the calibration and the enumeration wait and carries on where it stopped.
+// NOTE: .noinit must be outside the startup .bss clear; Link.ld gives it its own
+// NOLOAD output section after _ebss. Any other reset cause, or a bad magic/CRC,
+// takes the normal cold start path.
+
+#define PROGRESS_SCAN 0x01      // Scan timer published a frame
+#define PROGRESS_LOOP 0x02      // Main loop processed a frame
+#define PROGRESS_HID  0x04      // Report queue moved, is empty, or there is no host
+#define PROGRESS_ALL  (PROGRESS_SCAN | PROGRESS_LOOP | PROGRESS_HID)
+
+#define RETAINED_MAGIC 0x4E544552  // "RETN"
+
+typedef struct {
+    uint16_t base_cal[NUM_KEYS][TOUCH_HOPS];
+    TouchCfg cfg;
+    uint8_t  pressed[NUM_KEYS];
+    uint32_t faults;
+    uint32_t rebaselines;
+    uint32_t wdt_resets;
+    uint32_t dropped;
+    uint32_t bus_resets;
+    uint32_t stalls;
+    uint32_t overruns;
+    uint32_t timeouts;
+} RetainedData;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;               // Over d
+    volatile uint8_t progress;  // PROGRESS_* since the last kick (not covered by crc)
+    RetainedData d;
+} Retained;
+
+__attribute__((section(".noinit"))) Retained retained;
+
+/**
+ * Flag progress of one subsystem (main loop or ISR)
+ */
+void Progress_Mark(uint8_t bits) {
+    retained.progress |= bits;
+}
+
+/**
+ * Returns 1 (and starts a new round) once every subsystem made progress
+ */
+uint8_t Progress_Complete(void) {
+    if ((retained.progress & PROGRESS_ALL) != PROGRESS_ALL) return 0;
+    retained.progress = 0;
+    return 1;
+}
+
+uint32_t Retained_Crc(const RetainedData *d) {
+    return Dfu_Crc32(0xFFFFFFFF, (const uint8_t *)d, sizeof(*d)) ^ 0xFFFFFFFF;
+}
+
+/**
+ * Mirror the live state into retained RAM
+ */
+void Retained_Save(void) {
+    RetainedData *d = &retained.d;
+
+    memcpy(d->base_cal, touch_st.base_cal, sizeof(d->base_cal));
+    d->cfg = touch_cfg;
+    d->cfg.recal_req = 0;
+    memcpy(d->pressed, touch_st.pressed, sizeof(d->pressed));
+    d->faults = health.faults;
+    d->rebaselines = health.rebaselines;
+    d->wdt_resets = health.wdt_resets;
+    d->dropped = hid_q.dropped;
+    d->bus_resets = UsbBusResetCount;
+    d->stalls = UsbStallCount;
+    d->overruns = scan_clk.overruns;
+    d->timeouts = HwPollTimeouts;
+    retained.crc = Retained_Crc(d);
+    retained.magic = RETAINED_MAGIC;
+}
+
+uint8_t Retained_Valid(void) {
+    return retained.magic == RETAINED_MAGIC && retained.crc == Retained_Crc(&retained.d);
+}
+
+/**
+ * Restore baselines, configuration, key state and the counters after a watchdog
+ * reset. Counters are added, so events since boot are kept.
+ * Returns 0 (nothing restored) if the block is not valid.
+ */
+uint8_t Retained_Restore(void) {
+    const RetainedData *d = &retained.d;
+
+    if (!Retained_Valid()) return 0;
+    memcpy(touch_st.base_cal, d->base_cal, sizeof(touch_st.base_cal));
+    touch_cfg = d->cfg;
+    memcpy(touch_st.pressed, d->pressed, sizeof(touch_st.pressed));
+    health.faults = d->faults;
+    health.rebaselines = d->rebaselines;
+    health.wdt_resets = d->wdt_resets + 1;
+    health.wdt_stalled = ~retained.progress & PROGRESS_ALL;
+    hid_q.dropped += d->dropped;
+    UsbBusResetCount += d->bus_resets;
+    UsbStallCount += d->stalls;
+    scan_clk.overruns += d->overruns;
+    HwPollTimeouts += d->timeouts;
+    return 1;
+}
+
+#endif
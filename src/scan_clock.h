@@ -0,0 +1,168 @@
+#ifndef SCAN_CLOCK_H
+#define SCAN_CLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "touch.h"
+
+// --- Fixed-rate scan clock ---
+//
+// A hardware timer (TMR0 in main.c) fires at scan_hz and its ISR acquires one
+// complete sweep into a double buffer. The main loop takes the finished frame
+// and does everything that takes a variable amount of time (debounce, reports,
+// printf) outside the sampling path, so the sample interval is set by the timer
+// and not by the loop body.
+//
+// The timer reloads in hardware, so the only jitter left is the interrupt entry
+// latency, read back from the timer count at ISR entry. A frame that is published
+// while the previous one has not been taken yet is a missed deadline (overrun).
+// Every frame is stamped with its sample time in microseconds, counted in whole
+// timer periods plus the entry latency, for the touch event stream (touch_event.h).
+// The timer itself is driven from main.c, so bench/test_scan runs this file on
+// the host.
+
+#define SCAN_HZ_MIN 10          // Lowest accepted rate (idle/suspend rates must be >= this)
+#define SCAN_HZ_MAX 5000        // Highest accepted rate; the sweep itself must fit one period
+#define SCAN_SWEEP_MARGIN 2     // A period must be this many times the measured sweep (the rest is main loop time)
+
+// Raw conversions of one sweep, as taken by the timer ISR
+typedef struct {
+    uint16_t raw[NUM_KEYS][TOUCH_HOPS];
+#ifdef KEYBOARD_GUARD_CH
+    uint16_t guard_raw;
+#endif
+    uint32_t t_us;              // Sample time (wraps after ~71 minutes)
+} ScanFrame;
+
+typedef struct {
+    ScanFrame buf[2];
+    uint8_t wr;                 // Buffer the ISR fills next
+    volatile uint8_t ready;     // 1 + index of the published frame, 0 if none pending
+    uint16_t hz;                // Current scan rate
+    uint32_t period;            // Timer reload value in system clock ticks
+    uint32_t clk;               // System clock the period was derived from
+    uint32_t mhz;               // clk in MHz (ticks per microsecond)
+    uint32_t period_us;         // period = period_us * mhz + period_rem ticks
+    uint32_t period_rem;
+    uint32_t t_us;              // Time of the last period boundary (a rate change drops the partial period)
+    uint32_t t_rem;             // Sub-microsecond remainder of t_us, in ticks
+
+    // Timing since the last clock change, in system clock ticks
+    uint32_t lat_min;           // ISR entry latency after the period boundary
+    uint32_t lat_max;
+    uint32_t lat_avg;           // EWMA, x16 fixed point
+    uint32_t sweep_max;         // Longest acquisition inside the ISR
+
+    uint32_t frames;            // Frames published
+    uint32_t overruns;          // Frames published before the previous one was taken
+} ScanClock;
+
+ScanClock scan_clk;
+
+/**
+ * Timer reload value for a scan rate at a given system clock
+ */
+uint32_t ScanClock_Period(uint32_t clk, uint16_t hz) {
+    return clk / hz;
+}
+
+/**
+ * Clear the timing statistics (after a system clock change, the tick unit changes)
+ */
+void ScanClock_ResetTiming(ScanClock *sc) {
+    sc->lat_min = UINT32_MAX;
+    sc->lat_max = 0;
+    sc->lat_avg = 0;
+    sc->sweep_max = 0;
+}
+
+/**
+ * Set rate and clock; the timer is then reloaded with sc->period.
+ * Statistics restart on a clock change, since the tick unit changes.
+ */
+void ScanClock_Configure(ScanClock *sc, uint32_t clk, uint16_t hz) {
+    if (clk != sc->clk) ScanClock_ResetTiming(sc);
+    sc->hz = hz;
+    sc->clk = clk;
+    sc->mhz = clk / 1000000;
+    sc->period = ScanClock_Period(clk, hz);
+    sc->period_us = sc->period / sc->mhz;
+    sc->period_rem = sc->period % sc->mhz;
+}
+
+/**
+ * Frame buffer the ISR acquires into
+ */
+ScanFrame *ScanClock_WriteBuf(ScanClock *sc) {
+    return &sc->buf[sc->wr];
+}
+
+/**
+ * ISR side: account entry latency and acquisition time (both in timer ticks)
+ * and publish the frame just written. Returns 0 if the previous frame was
+ * still pending, i.e. the main loop missed its deadline.
+ */
+uint8_t ScanClock_Publish(ScanClock *sc, uint32_t latency, uint32_t sweep) {
+    uint8_t ok = (sc->ready == 0);
+
+    if (sc->lat_min == UINT32_MAX) sc->lat_avg = latency << 4;
+    else sc->lat_avg += (int32_t)((latency << 4) - sc->lat_avg) >> 3;
+    if (latency < sc->lat_min) sc->lat_min = latency;
+    if (latency > sc->lat_max) sc->lat_max = latency;
+    if (sweep > sc->sweep_max) sc->sweep_max = sweep;
+
+    // This entry belongs to the period boundary that just passed
+    sc->t_us += sc->period_us;
+    sc->t_rem += sc->period_rem;
+    if (sc->t_rem >= sc->mhz) {
+        sc->t_us++;
+        sc->t_rem -= sc->mhz;
+    }
+    sc->buf[sc->wr].t_us = sc->t_us + latency / sc->mhz;
+
+    if (!ok) sc->overruns++;
+    sc->frames++;
+    sc->ready = sc->wr + 1;
+    sc->wr ^= 1;
+    return ok;
+}
+
+/**
+ * Main loop side: take the published frame, or NULL if none is pending.
+ * The ISR starts overwriting this buffer when it acquires the frame after the
+ * next one, which can be as little as one period after the take: copy it out
+ * straight away. Reading and clearing ready is not atomic, call with the scan
+ * interrupt held off (main.c) or a frame published in between is lost.
+ */
+const ScanFrame *ScanClock_Take(ScanClock *sc) {
+    uint8_t r = sc->ready;
+    if (r == 0) return NULL;
+    sc->ready = 0;
+    return &sc->buf[r - 1];
+}
+
+/**
+ * Peak-to-peak sample clock jitter in nanoseconds
+ */
+/**
+ * Highest scan rate the measured sweep leaves room for: the period has to hold
+ * entry latency plus sweep SCAN_SWEEP_MARGIN times over. SCAN_HZ_MAX until a
+ * sweep has been measured at the current clock.
+ */
+uint16_t ScanClock_MaxHz(const ScanClock *sc) {
+    uint32_t need, hz;
+
+    if (sc->sweep_max == 0 || sc->lat_min == UINT32_MAX) return SCAN_HZ_MAX;
+    need = SCAN_SWEEP_MARGIN * (sc->lat_max + sc->sweep_max);
+    hz = sc->clk / need;
+    if (hz > SCAN_HZ_MAX) return SCAN_HZ_MAX;
+    if (hz < SCAN_HZ_MIN) return SCAN_HZ_MIN;
+    return hz;
+}
+
+uint32_t ScanClock_JitterNs(const ScanClock *sc) {
+    if (sc->lat_min == UINT32_MAX || sc->clk == 0) return 0;
+    return (uint32_t)((uint64_t)(sc->lat_max - sc->lat_min) * 1000000000u / sc->clk);
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef TOUCH_H
+#define TOUCH_H
+
+#include <stdint.h>
+#include "keyboard_def.h"
+
+// --- TouchKey channel / key definitions ---
+// NOTE: These are the power-on defaults. Everything in TouchCfg can be changed
+// at runtime from the UART console (see console.h) without reflashing.
+
+#define TOUCH_THRES 140         // Default drop below baseline that counts as a touch
+#define TOUCH_BASE_SAMPLES 8    // Samples averaged per channel during calibration
+#define TOUCH_DEBOUNCE 1        // Default consecutive scans needed to change key state
+#define TOUCH_SCAN_HZ 100       // Default scan rate (timer triggered, see scan_clock.h)
+
+// Noise hopping: every key is converted once per hop with a different TouchKey
+// charge count (RB_TKEY_CHARG_CNT in R8_TKEY_COUNT), i.e. a different effective
+// sampling frequency. The per-key result is the median of the per-hop deltas, so noise
+// locked to one frequency (charger, LED PWM) is outvoted by the others.
+// Conversions per sweep are fixed at NUM_KEYS * TOUCH_HOPS, which bounds the sweep time.
+#define TOUCH_HOPS 3            // 1..3
+#define TOUCH_HOP_STEP 3        // Charge count offset between hops
+_Static_assert(TOUCH_HOPS >= 1 && TOUCH_HOPS <= 3, "TOUCH_HOPS must be 1..3");
+
+// Channel order and default keymap, expanded from KEYBOARD_KEYS (keyboard_def.h)
+const uint8_t tkey_ch[] = { KEYBOARD_KEYS(KEYDEF_CH) };
+const uint16_t key_map_default[] = { KEYBOARD_KEYS(KEYDEF_CODE) };
+#define NUM_KEYS KEYBOARD_NUM_KEYS
+
+// Runtime-tunable configuration
+typedef struct {
+    uint16_t thres[NUM_KEYS];     // Per-channel touch threshold (raw ADC counts)
+    uint8_t  debounce[NUM_KEYS];  // Per-channel debounce (consecutive scans)
+    uint16_t key_map[NUM_KEYS];   // Per-channel HID keycode or CONSUMER(usage)
+    uint16_t scan_hz;             // Scan rate while active
+    volatile uint8_t recal_req;   // Set to request a baseline re-calibration
+    uint8_t  trace;               // Stream per-hop deltas every sweep ("T," lines)
+} TouchCfg;
+
+// Runtime state and statistics
+typedef struct {
+    uint16_t base_cal[NUM_KEYS][TOUCH_HOPS];  // Untouched baseline per channel and hop
+    uint16_t raw[NUM_KEYS][TOUCH_HOPS];       // Last raw reading per channel and hop
+    int16_t  delta[NUM_KEYS];     // Last combined (median) drop below baseline
+    uint32_t noise[NUM_KEYS][TOUCH_HOPS];     // Mean |hop delta - median|, x16 fixed point (|dev| << 4 needs > 16 bits)
+    uint32_t rejects[NUM_KEYS][TOUCH_HOPS];   // Sweeps where a hop was an outlier (> thres/2 off)
+#ifdef KEYBOARD_GUARD_CH
+    uint16_t guard_base;          // Guard pad baseline (hop 0 only)
+    int16_t  guard_delta;         // Guard pad drop below baseline
+#endif
+    uint8_t  count[NUM_KEYS];     // Debounce counter per channel
+    uint8_t  pressed[NUM_KEYS];   // Debounced key state per channel
+    uint32_t presses[NUM_KEYS];   // Number of debounced presses per channel
+    uint32_t scans;               // Completed scan sweeps
+    uint32_t t_us;                // Sample time of the last sweep (scan clock)
+} TouchState;
+
+TouchCfg touch_cfg;
+TouchState touch_st;
+
+/**
+ * Load the compile-time defaults into the runtime configuration
+ */
+void TouchCfg_Defaults(void) {
+    for (int k = 0; k < NUM_KEYS; k++) {
+        touch_cfg.thres[k] = TOUCH_THRES;
+        touch_cfg.debounce[k] = TOUCH_DEBOUNCE;
+        touch_cfg.key_map[k] = key_map_default[k];
+    }
+    touch_cfg.scan_hz = TOUCH_SCAN_HZ;
+    touch_cfg.recal_req = 0;
+    touch_cfg.trace = 0;
+}
+
+/**
+ * Combine the per-hop readings of key k (already in touch_st.raw[k]) into one
+ * delta, and update the per-hop noise metrics. Returns the median delta.
+ */
+int16_t Touch_HopCombine(uint8_t k) {
+    int16_t d[TOUCH_HOPS], med, dev;
+
+    for (int h = 0; h < TOUCH_HOPS; h++) {
+        d[h] = touch_st.base_cal[k][h] - touch_st.raw[k][h];
+    }
+#if TOUCH_HOPS == 3
+    // Median of three without sorting
+    if ((d[0] > d[1]) != (d[0] > d[2]))      med = d[0];
+    else if ((d[1] > d[0]) != (d[1] > d[2])) med = d[1];
+    else                                     med = d[2];
+#elif TOUCH_HOPS == 2
+    med = (d[0] + d[1]) / 2;
+#else
+    med = d[0];
+#endif
+
+    for (int h = 0; h < TOUCH_HOPS; h++) {
+        dev = d[h] - med;
+        if (dev < 0) dev = -dev;
+        // EWMA with alpha 1/8, kept x16 so small deviations still register
+        touch_st.noise[k][h] += ((int32_t)(dev << 4) - (int32_t)touch_st.noise[k][h]) >> 3;
+        if (dev > (touch_cfg.thres[k] >> 1)) touch_st.rejects[k][h]++;
+    }
+    touch_st.delta[k] = med;
+    return med;
+}
+
+/**
+ * Re-acquire the baseline of key k from its current readings and release it
+ */
+void Touch_Rebase(uint8_t k) {
+    for (int h = 0; h < TOUCH_HOPS; h++) {
+        touch_st.base_cal[k][h] = touch_st.raw[k][h];
+    }
+    touch_st.delta[k] = 0;
+    touch_st.pressed[k] = 0;
+    touch_st.count[k] = 0;
+}
+
+/**
+ * Feed one combined delta into the per-channel debouncer.
+ * Returns the debounced "pressed" state of the channel.
+ */
+uint8_t Touch_Debounce(uint8_t k, int16_t delta) {
+    uint8_t active = (delta > (int16_t)touch_cfg.thres[k]);
+
+    if (active == touch_st.pressed[k]) {
+        touch_st.count[k] = 0;
+    } else if (++touch_st.count[k] >= touch_cfg.debounce[k]) {
+        touch_st.count[k] = 0;
+        touch_st.pressed[k] = active;
+        if (active) touch_st.presses[k]++;
+    }
+    return touch_st.pressed[k];
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef TOUCH_EVENT_H
+#define TOUCH_EVENT_H
+
+#include <stdint.h>
+
+// --- Timestamped touch event stream ---
+//
+// One event per debounced state change of a key, stamped with the sample time
+// of the frame that caused it (scan clock microseconds, see scan_clock.h). The
+// main loop produces them, the gesture recogniser (gesture.h) consumes them, and
+// with "trace 1" they are also printed as "E,<t_us>,<key>,<down>" lines so a
+// session can be recorded and fed back through gesture.h on the host.
+
+#define TOUCH_EVENT_QUEUE_LEN 16    // Must be a power of two
+
+typedef struct {
+    uint32_t t_us;              // Sample time of the frame
+    uint8_t  key;               // Key index (tkey_ch order)
+    uint8_t  down;              // 1 = touched, 0 = released
+} TouchEvent;
+
+typedef struct {
+    TouchEvent ev[TOUCH_EVENT_QUEUE_LEN];
+    uint8_t head;               // Next slot to write
+    uint8_t tail;               // Next slot to read
+    uint32_t dropped;           // Events lost to a full queue
+} TouchEventQueue;
+
+TouchEventQueue touch_ev;
+
+/**
+ * Append an event. Returns 0 (and counts a drop) if the queue is full.
+ */
+uint8_t TouchEvent_Push(TouchEventQueue *q, uint32_t t_us, uint8_t key, uint8_t down) {
+    uint8_t next = (q->head + 1) & (TOUCH_EVENT_QUEUE_LEN - 1);
+
+    if (next == q->tail) {
+        q->dropped++;
+        return 0;
+    }
+    q->ev[q->head].t_us = t_us;
+    q->ev[q->head].key = key;
+    q->ev[q->head].down = down;
+    q->head = next;
+    return 1;
+}
+
+/**
+ * Take the oldest event. Returns 0 if the queue is empty.
+ */
+uint8_t TouchEvent_Pop(TouchEventQueue *q, TouchEvent *out) {
+    if (q->head == q->tail) return 0;
+    *out = q->ev[q->tail];
+    q->tail = (q->tail + 1) & (TOUCH_EVENT_QUEUE_LEN - 1);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef TOUCH_FRAME_H
+#define TOUCH_FRAME_H
+
+#include <stdint.h>
+
+// --- Frame-level classification of a whole sweep ---
+//
+// A finger moves one pad (maybe a neighbour a little); a water film or a palm
+// moves all of them by a similar amount at once. Looking at the full delta
+// vector of a sweep lets us reject the latter before any key is debounced, and
+// a small summed shift on all pads (hand approaching) is used to switch the
+// scanner from the slow idle rate to the fast rate before the first touch.
+
+#define FRAME_WATER_PCT 50      // All pads above this % of their threshold ...
+#define FRAME_WATER_SPREAD_PCT 40  // ... and within this % of each other = water film
+#define FRAME_PROX_SUM 60       // Summed delta (counts) that counts as proximity
+#define FRAME_GUARD_THRES 80    // Guard/shield pad delta that blocks all keys
+#define FRAME_IDLE_FRAMES 100   // Quiet sweeps before dropping to the idle scan rate
+#define FRAME_IDLE_SCAN_HZ 20   // Idle scan rate (fast rate is touch_cfg.scan_hz)
+
+typedef enum {
+    FRAME_IDLE = 0,     // Nothing near the panel
+    FRAME_PROXIMITY,    // Something close, no key above threshold yet
+    FRAME_TOUCH,        // At least one key above threshold, pattern looks like a finger
+    FRAME_WATER,        // Uniform shift on every pad: keys suppressed
+    FRAME_GUARD         // Guard pad active: keys suppressed
+} FrameClass;
+
+typedef struct {
+    uint8_t cls;                // Class of the last frame
+    uint8_t fast;               // Scanning at the fast rate
+    uint16_t quiet;             // Consecutive FRAME_IDLE frames
+    uint32_t count[5];          // Frames per class
+} TouchFrameState;
+
+TouchFrameState touch_frame;
+
+/**
+ * Classify one sweep. delta/thres are per key, guard_delta is the guard pad's
+ * delta (pass 0 when the board has no guard pad).
+ */
+uint8_t Touch_ClassifyFrame(const int16_t *delta, const uint16_t *thres, uint8_t n, int16_t guard_delta) {
+    int32_t sum = 0;
+    int16_t lo = INT16_MAX, hi = INT16_MIN;
+    uint8_t above = 0, wet = 0;
+
+    if (guard_delta > FRAME_GUARD_THRES) return FRAME_GUARD;
+
+    for (uint8_t k = 0; k < n; k++) {
+        int16_t d = delta[k];
+        if (d > 0) sum += d;
+        if (d < lo) lo = d;
+        if (d > hi) hi = d;
+        if (d > (int16_t)thres[k]) above++;
+        if (d * 100 > (int32_t)thres[k] * FRAME_WATER_PCT) wet++;
+    }
+
+    // Every pad shifted substantially and by roughly the same amount
+    if (n > 1 && wet == n && (hi - lo) * 100 <= (int32_t)hi * FRAME_WATER_SPREAD_PCT) {
+        return FRAME_WATER;
+    }
+    if (above) return FRAME_TOUCH;
+    if (sum > FRAME_PROX_SUM) return FRAME_PROXIMITY;
+    return FRAME_IDLE;
+}
+
+/**
+ * Account a classified frame and update the fast/idle scan decision.
+ * Returns 1 when key presses must be suppressed for this frame.
+ */
+uint8_t Touch_FrameUpdate(uint8_t cls) {
+    touch_frame.cls = cls;
+    touch_frame.count[cls]++;
+    if (cls == FRAME_IDLE) {
+        if (touch_frame.quiet < FRAME_IDLE_FRAMES) touch_frame.quiet++;
+        else touch_frame.fast = 0;
+    } else {
+        // Anything near the panel pre-wakes the scanner
+        touch_frame.quiet = 0;
+        touch_frame.fast = 1;
+    }
+    return cls == FRAME_WATER || cls == FRAME_GUARD;
+}
+
+#endif
@@ -6,4 +6,30 @@
 #define DevEP0SIZE 0x40
 #define UEP_T_RES_MASK 0x03
 
+#ifndef USB_REQ_TYP_IN
+#define USB_REQ_TYP_IN 0x80     // bmRequestType direction: device to host
+#endif
+
+// HID class requests (HID 1.11 section 7.2)
+#ifndef HID_GET_REPORT
+#define HID_GET_REPORT   0x01
+#define HID_GET_IDLE     0x02
+#define HID_GET_PROTOCOL 0x03
+#define HID_SET_REPORT   0x09
+#define HID_SET_IDLE     0x0A
+#define HID_SET_PROTOCOL 0x0B
+#endif
+
+// Standard feature selectors (SET/CLEAR_FEATURE wValue)
+#define USB_FEATURE_ENDPOINT_HALT 0x00
+#define USB_FEATURE_REMOTE_WAKEUP 0x01
+
+// Device states (USB 2.0 chapter 9.1)
+typedef enum {
+    USB_STATE_DEFAULT = 0,      // After bus reset, address 0
+    USB_STATE_ADDRESSED,        // SET_ADDRESS done, not configured
+    USB_STATE_CONFIGURED,       // SET_CONFIGURATION(1) done, EP1 live
+    USB_STATE_SUSPENDED         // Bus idle > 3 ms, previous state kept aside
+} UsbDevState;
+
 #endif
\ No newline at end of file
@@ -2,9 +2,10 @@
 #define USB_DESCRIPTORS_H
 
 #include "usb_defs.h"
+#include "keyboard_def.h"
+#include "hid_report.h"
 
 // --- USB Descriptors (Adapted for CH582M) ---
-// Note: We are switching back to a standard 8-byte Keyboard Report Descriptor.
 
 const uint8_t MyDevDescr[] = {
     0x12,       // bLength
@@ -23,6 +24,77 @@ const uint8_t MyDevDescr[] = {
     0x01        // bNumConfigurations
 };
 
+// HID Report Descriptor, layout selected in hid_report.h.
+// Default: standard 8-byte boot keyboard report.
+const uint8_t MyHIDReportDescr[] = {
+    0x05, 0x01,  // Usage Page (Generic Desktop)
+    0x09, 0x06,  // Usage (Keyboard)
+    0xA1, 0x01,  // Collection (Application)
+#ifdef HID_REPORT_IDS
+    0x85, HID_ID_KEYBOARD,  //   Report ID (1)
+#endif
+    0x05, 0x07,  //   Usage Page (Keyboard)(Key Codes)
+    0x19, 0xE0,  //   Usage Minimum (224)
+    0x29, 0xE7,  //   Usage Maximum (231)
+    0x15, 0x00,  //   Logical Minimum (0)
+    0x25, 0x01,  //   Logical Maximum (1)
+    0x75, 0x01,  //   Report Size (1)
+    0x95, 0x08,  //   Report Count (8)
+    0x81, 0x02,  //   Input (Data, Var, Abs) ; Modifier byte
+#ifndef CONFIG_HID_NKRO
+    0x95, 0x01,  //   Report Count (1)
+    0x75, 0x08,  //   Report Size (8)
+    0x81, 0x01,  //   Input (Const) ; Reserved byte
+#endif
+    0x95, 0x05,  //   Report Count (5)
+    0x75, 0x01,  //   Report Size (1)
+    0x05, 0x08,  //   Usage Page (LEDs)
+    0x19, 0x01,  //   Usage Minimum (1)
+    0x29, 0x05,  //   Usage Maximum (5)
+    0x91, 0x02,  //   Output (Data, Var, Abs) ; 5 LEDs
+    0x95, 0x01,  //   Report Count (1)
+    0x75, 0x03,  //   Report Size (3)
+    0x91, 0x01,  //   Output (Const) ; LED padding
+#ifdef CONFIG_HID_NKRO
+    0x05, 0x07,  //   Usage Page (Keyboard)
+    0x19, 0x00,  //   Usage Minimum (0)
+    0x29, KEYBOARD_USAGE_MAX,  //   Usage Maximum (101)
+    0x15, 0x00,  //   Logical Minimum (0)
+    0x25, 0x01,  //   Logical Maximum (1)
+    0x75, 0x01,  //   Report Size (1)
+    0x95, KEYBOARD_USAGE_MAX + 1,  //   Report Count (102)
+    0x81, 0x02,  //   Input (Data, Var, Abs) ; one bit per key
+#if (KEYBOARD_USAGE_MAX + 1) % 8
+    0x95, 8 - (KEYBOARD_USAGE_MAX + 1) % 8,  //   Report Count (pad to a byte)
+    0x81, 0x01,  //   Input (Const) ; bitmap padding
+#endif
+#else
+    0x95, 0x06,  //   Report Count (6)
+    0x75, 0x08,  //   Report Size (8)
+    0x15, 0x00,  //   Logical Minimum (0)
+    0x25, KEYBOARD_USAGE_MAX,  //   Logical Maximum (101)
+    0x05, 0x07,  //   Usage Page (Keyboard)
+    0x19, 0x00,  //   Usage Minimum (0)
+    0x29, KEYBOARD_USAGE_MAX,  //   Usage Maximum (101)
+    0x81, 0x00,  //   Input (Data, Array) ; 6 keycodes
+#endif
+    0xC0,        // End Collection
+#ifdef CONFIG_HID_CONSUMER
+    0x05, 0x0C,  // Usage Page (Consumer)
+    0x09, 0x01,  // Usage (Consumer Control)
+    0xA1, 0x01,  // Collection (Application)
+    0x85, HID_ID_CONSUMER,  //   Report ID (2)
+    0x15, 0x00,  //   Logical Minimum (0)
+    0x26, 0xFF, 0x03,  //   Logical Maximum (1023)
+    0x19, 0x00,  //   Usage Minimum (0)
+    0x2A, 0xFF, 0x03,  //   Usage Maximum (1023)
+    0x75, 0x10,  //   Report Size (16)
+    0x95, 0x01,  //   Report Count (1)
+    0x81, 0x00,  //   Input (Data, Array) ; one usage
+    0xC0,        // End Collection
+#endif
+};
+
 // Configuration Descriptor (Keyboard with 1 endpoint)
 const uint8_t MyCfgDescr[] = {
     // --- Configuration Header ---
@@ -53,53 +125,17 @@ const uint8_t MyCfgDescr[] = {
     0x00,       // bCountryCode = Not localized
     0x01,       // bNumDescriptors
     0x22,       // bDescriptorType = Report
-    0x3F, 0x00, // wDescriptorLength = 63 bytes (fixed below)
+    sizeof(MyHIDReportDescr) & 0xFF, sizeof(MyHIDReportDescr) >> 8, // wDescriptorLength
 
     // --- Endpoint Descriptor (IN interrupt) ---
     0x07,       // bLength
     0x05,       // bDescriptorType = Endpoint
     0x81,       // bEndpointAddress = IN endpoint #1
     0x03,       // bmAttributes = Interrupt
-    0x08, 0x00, // wMaxPacketSize = 8 bytes
+    HID_REPORT_MAX, 0x00, // wMaxPacketSize = largest report
     0x0A        // bInterval = 10 ms
 };
 
-// Standard HID Keyboard Report Descriptor (8-byte report)
-const uint8_t MyHIDReportDescr[] = {
-    0x05, 0x01,  // Usage Page (Generic Desktop)
-    0x09, 0x06,  // Usage (Keyboard)
-    0xA1, 0x01,  // Collection (Application)
-    0x05, 0x07,  //   Usage Page (Keyboard)(Key Codes)
-    0x19, 0xE0,  //   Usage Minimum (224)
-    0x29, 0xE7,  //   Usage Maximum (231)
-    0x15, 0x00,  //   Logical Minimum (0)
-    0x25, 0x01,  //   Logical Maximum (1)
-    0x75, 0x01,  //   Report Size (1)
-    0x95, 0x08,  //   Report Count (8)
-    0x81, 0x02,  //   Input (Data, Var, Abs) ; Modifier byte
-    0x95, 0x01,  //   Report Count (1)
-    0x75, 0x08,  //   Report Size (8)
-    0x81, 0x01,  //   Input (Const) ; Reserved byte
-    0x95, 0x05,  //   Report Count (5)
-    0x75, 0x01,  //   Report Size (1)
-    0x05, 0x08,  //   Usage Page (LEDs)
-    0x19, 0x01,  //   Usage Minimum (1)
-    0x29, 0x05,  //   Usage Maximum (5)
-    0x91, 0x02,  //   Output (Data, Var, Abs) ; 5 LEDs
-    0x95, 0x01,  //   Report Count (1)
-    0x75, 0x03,  //   Report Size (3)
-    0x91, 0x01,  //   Output (Const) ; LED padding
-    0x95, 0x06,  //   Report Count (6)
-    0x75, 0x08,  //   Report Size (8)
-    0x15, 0x00,  //   Logical Minimum (0)
-    0x25, 0x65,  //   Logical Maximum (101)
-    0x05, 0x07,  //   Usage Page (Keyboard)
-    0x19, 0x00,  //   Usage Minimum (0)
-    0x29, 0x65,  //   Usage Maximum (101)
-    0x81, 0x00,  //   Input (Data, Array) ; 6 keycodes
-    0xC0         // End Collection
-};
-
 // String Descriptors
 const uint8_t MyLangDescr[] = { 0x04, 0x03, 0x09, 0x04 }; // Language 0x0409 (US English)
 const uint8_t MyManuInfo[] = { 0x10, 0x03,'G',0,'e',0,'n',0,'e',0,'r',0,'i',0,'c',0 };
@@ -0,0 +1,509 @@
+#ifndef USB_DEVICE_H
+#define USB_DEVICE_H
+
+#include <stdio.h>
+#include <string.h>
+#include "CH58x_common.h"
+#include "usb_defs.h"
+#include "usb_descriptors.h"
+#include "hid_report.h"
+
+// --- USB full-speed HID device: chapter 9 + HID class requests on EP0, reports on EP1 ---
+
+
+// --- Global Variables (Adapted for CH582M) ---
+// Extern declarations for USB DMA pointers (see SDK's CH58x_usbdev.c/.h)
+
+
+uint8_t DevConfig, Ready;
+
+// Device state machine (see UsbDevState in usb_defs.h)
+volatile uint8_t UsbState = USB_STATE_DEFAULT;
+volatile uint8_t UsbStateBeforeSuspend;
+volatile uint8_t UsbRemoteWakeupEn;     // Set by the host with SET_FEATURE(DEVICE_REMOTE_WAKEUP)
+uint8_t Ep1CtrlBeforeSuspend;
+uint8_t SetupReqCode, SetupReqType;
+uint16_t SetupReqLen;
+const uint8_t *pDescr;
+
+// HID class state
+uint8_t UsbIdleRate;                    // SET_IDLE duration, 4 ms units (0 = only on change)
+uint8_t UsbProtocol = 1;                // 0 = boot, 1 = report
+uint8_t UsbLedState;                    // Last SET_REPORT output (Num/Caps/Scroll lock ...)
+HidReport HidLastReport[HID_CHANNELS];  // Returned by GET_REPORT, per HidChannel
+
+// Small replies (status, configuration, ...) are built here and sent through pDescr
+__attribute__((aligned(4))) uint8_t UsbReplyBuf[64];
+
+// Serial number string, built from the chip unique ID by USB_InitSerial()
+uint8_t MySerialInfo[2 + 16 * 2];
+
+// EP0 setup packet buffer (Needed as pSetupReqPak is usually an alias to this)
+__attribute__((aligned(4))) uint8_t UsbSetupBuf[8];
+#define pSetupReqPak ((USB_SETUP_REQ *)UsbSetupBuf)
+
+// User-allocated RAM
+__attribute__((aligned(4)))  uint8_t EP0_Databuf[64];
+__attribute__((aligned(4)))  uint8_t EP1_Databuf[64 + 64];
+
+#define EP1_TX_Buf (EP1_Databuf + 64)  // TX buffer for EP1 is at offset +64 (IN buffer)
+
+// Vendor request hooks, implemented by the application (firmware update, see main.c)
+#define USB_VENDOR_STALL 0xFF
+uint8_t USB_VendorSetup(void);      // Returns the IN reply length (in UsbReplyBuf) or USB_VENDOR_STALL
+void USB_VendorOut(uint8_t len);    // OUT data stage; must arm the status stage itself
+
+// ====================================================================
+// === ENUMERATION TRACE ===
+// ====================================================================
+
+// Every SETUP packet (and bus reset) is logged until the buffer is full, so the
+// first USB_TRACE_LEN requests after power-up, i.e. the enumeration, are kept.
+#define USB_TRACE_LEN 32
+#define USB_TRACE_OK 0
+#define USB_TRACE_STALL 1
+#define USB_TRACE_RESET 2
+
+typedef struct {
+    uint8_t bRequestType;
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+    uint8_t result;
+} UsbTraceEntry;
+
+UsbTraceEntry UsbTrace[USB_TRACE_LEN];
+volatile uint8_t UsbTraceCount;
+volatile uint32_t UsbStallCount;
+volatile uint32_t UsbBusResetCount;
+
+void USB_TraceAdd(uint8_t result) {
+    UsbTraceEntry *t;
+    if (UsbTraceCount >= USB_TRACE_LEN) return;
+    t = &UsbTrace[UsbTraceCount++];
+    if (result == USB_TRACE_RESET) {
+        memset(t, 0, sizeof(*t));
+    } else {
+        t->bRequestType = pSetupReqPak->bRequestType;
+        t->bRequest = pSetupReqPak->bRequest;
+        t->wValue = pSetupReqPak->wValue;
+        t->wIndex = pSetupReqPak->wIndex;
+        t->wLength = pSetupReqPak->wLength;
+    }
+    t->result = result;
+}
+
+void USB_TraceDump(void) {
+    printf("usb trace %u, stalls %lu, resets %lu\n",
+        UsbTraceCount, (unsigned long)UsbStallCount, (unsigned long)UsbBusResetCount);
+    for (int i = 0; i < UsbTraceCount; i++) {
+        UsbTraceEntry *t = &UsbTrace[i];
+        if (t->result == USB_TRACE_RESET) {
+            printf("%2d  BUS RESET\n", i);
+        } else {
+            printf("%2d  %02X %02X %04X %04X %04X %s\n", i,
+                t->bRequestType, t->bRequest, t->wValue, t->wIndex, t->wLength,
+                t->result == USB_TRACE_STALL ? "STALL" : "ok");
+        }
+    }
+}
+
+// ====================================================================
+// === EP1 REPORT TRANSPORT ===
+// ====================================================================
+
+/**
+ * USB Endpoint 1 Transmit
+ */
+void DevEP1_IN_Transmit(uint16_t len) {
+    R8_UEP1_T_LEN = len;
+    // Clear response mask and set to ACK
+    R8_UEP1_CTRL = (R8_UEP1_CTRL & ~UEP_T_RES_MASK) | UEP_T_RES_ACK;
+}
+
+HidQueue hid_q;
+
+/**
+ * EP1 can take a report once configured (and not suspended) and the previous
+ * one was collected (T_RES == NAK)
+ */
+uint8_t UsbHid_Ready(void) {
+    return UsbState == USB_STATE_CONFIGURED && (R8_UEP1_CTRL & UEP_T_RES_MASK) == UEP_T_RES_NAK;
+}
+
+void UsbHid_Send(uint8_t ch, const uint8_t *buf, uint8_t len) {
+    // Copy to EP1_TX_Buf (IN buffer at offset +64)
+    HidReport *last = &HidLastReport[ch];
+    memcpy(EP1_TX_Buf, buf, len);
+    memcpy(last->data, buf, len);
+    last->ch = ch;
+    last->len = len;
+    DevEP1_IN_Transmit(len);
+}
+
+// EP1 holds a single packet, so one report per flush
+const HidTransport usb_hid_transport = { "USB", UsbHid_Ready, UsbHid_Send, 1 };
+
+/**
+ * Build the serial number string descriptor from the 8-byte chip unique ID
+ */
+void USB_InitSerial(void) {
+    static const char hex[] = "0123456789ABCDEF";
+    uint8_t id[8];
+
+    GetUniqueID(id);
+    MySerialInfo[0] = sizeof(MySerialInfo);
+    MySerialInfo[1] = USB_DESCR_TYP_STRING;
+    for (int i = 0; i < 8; i++) {
+        MySerialInfo[2 + i * 4 + 0] = hex[id[i] >> 4];
+        MySerialInfo[2 + i * 4 + 1] = 0;
+        MySerialInfo[2 + i * 4 + 2] = hex[id[i] & 0x0F];
+        MySerialInfo[2 + i * 4 + 3] = 0;
+    }
+}
+
+
+// ====================================================================
+// === CORE USB ENUMERATION HANDLER (USB_DevTransProcess) ===
+// ====================================================================
+
+void USB_DevTransProcess( void )
+{
+    uint8_t len, chtype;
+    uint8_t intflag, errflag = 0;
+
+    intflag = R8_USB_INT_FG;
+    if ( intflag & RB_UIF_TRANSFER )
+    {
+        if ( ( R8_USB_INT_ST & MASK_UIS_TOKEN ) != MASK_UIS_TOKEN ) // Not an idle/SETUP state
+        {
+            switch ( R8_USB_INT_ST & ( MASK_UIS_TOKEN | MASK_UIS_ENDP ) )
+            {
+                // --- IN Token (Host is ready to receive data) ---
+                case UIS_TOKEN_IN | 0: // Endpoint 0 IN
+                    if ( SetupReqType & USB_REQ_TYP_IN )
+                    {
+                        // Data stage of an IN request: load the next packet
+                        len = SetupReqLen >= DevEP0SIZE ? DevEP0SIZE : SetupReqLen;
+                        memcpy( pEP0_RAM_Addr, pDescr, len ); /* Load upload data */
+                        SetupReqLen -= len;
+                        pDescr += len;
+                        R8_UEP0_T_LEN = len;
+                        R8_UEP0_CTRL ^= RB_UEP_T_TOG; // Toggle PID
+                        break;
+                    }
+                    // Status stage of an OUT / no-data request
+                    if ( SetupReqCode == USB_SET_ADDRESS
+                         && ( SetupReqType & USB_REQ_TYP_MASK ) == USB_REQ_TYP_STANDARD )
+                    {
+                        // The new address only applies after the status stage
+                        R8_USB_DEV_AD = ( R8_USB_DEV_AD & RB_UDA_GP_BIT ) | SetupReqLen;
+                        UsbState = SetupReqLen ? USB_STATE_ADDRESSED : USB_STATE_DEFAULT;
+                    }
+                    R8_UEP0_T_LEN = 0;
+                    R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+                    break;
+
+                case UIS_TOKEN_OUT | 0: // Endpoint 0 OUT (Data or Status stage)
+                    // Wrong data toggle: the host resent a packet because our ACK got
+                    // lost. The SIE has ACKed it again; nothing to consume, and the
+                    // stage (and R8_UEP0_CTRL) stays as it is.
+                    if ( !( R8_USB_INT_ST & RB_UIS_TOG_OK ) )
+                        break;
+                    if ( !( SetupReqType & USB_REQ_TYP_IN ) )
+                    {
+                        // Data stage of an OUT request
+                        if ( ( SetupReqType & USB_REQ_TYP_MASK ) == USB_REQ_TYP_VENDOR )
+                        {
+                            USB_VendorOut( R8_USB_RX_LEN );
+                            break;
+                        }
+                        if ( ( SetupReqType & USB_REQ_TYP_MASK ) == USB_REQ_TYP_CLASS
+                             && SetupReqCode == HID_SET_REPORT && R8_USB_RX_LEN >= 1 )
+                        {
+#ifdef HID_REPORT_IDS
+                            // Report protocol output reports carry the report ID first
+                            if ( UsbProtocol && R8_USB_RX_LEN >= 2 && pEP0_RAM_Addr[0] == HID_ID_KEYBOARD )
+                                UsbLedState = pEP0_RAM_Addr[1];
+                            else
+#endif
+                            UsbLedState = pEP0_RAM_Addr[0];
+                        }
+                        R8_UEP0_T_LEN = 0;
+                        R8_UEP0_CTRL = RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_ACK;
+                        break;
+                    }
+                    // Status stage of an IN request
+                    R8_UEP0_T_LEN = 0;
+                    R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+                    break;
+
+                // --- Your Keyboard Endpoint ---
+                case UIS_TOKEN_IN | 1 : // Endpoint 1 IN
+                    // Toggle the PID and set back to NAK after sending one packet
+                    // --- FIX 2: Do NOT manually toggle if AUTO_TOG is enabled ---
+                    // R8_UEP1_CTRL ^= RB_UEP_T_TOG;  <-- DELETE THIS LINE
+
+                    // Just set it to NAK (and preserve the AUTO_TOG bit)
+                    R8_UEP1_CTRL = ( R8_UEP1_CTRL & ~UEP_T_RES_MASK ) | UEP_T_RES_NAK;
+                    break;
+                // No need for Endpoint 1 OUT (unless you want LED feedback)
+            }
+            R8_USB_INT_FG = RB_UIF_TRANSFER; // Clear Interrupt Flag
+        }
+
+        // --- SETUP Transaction on Endpoint 0 ---
+        if ( R8_USB_INT_ST & RB_UIS_SETUP_ACT )
+        {
+            // Set EP0 to ACK both IN/OUT, and set PID to DATA1 for the next transfer
+            R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_NAK;
+
+            // Copy setup packet from hardware buffer to UsbSetupBuf (pEP0_RAM_Addr is often mapped to UsbSetupBuf)
+            memcpy(UsbSetupBuf, pEP0_RAM_Addr, 8);
+
+            SetupReqLen = pSetupReqPak->wLength;
+            SetupReqCode = pSetupReqPak->bRequest;
+            SetupReqType = chtype = pSetupReqPak->bRequestType;
+
+            // Every IN request points pDescr at its reply and sets len to the reply size
+            pDescr = UsbReplyBuf;
+            len = 0;
+            errflag = 0;
+
+            if ( ( chtype & USB_REQ_TYP_MASK ) == USB_REQ_TYP_STANDARD )
+            {
+                switch ( SetupReqCode )
+                {
+                    case USB_GET_DESCRIPTOR :
+                    {
+                        switch ( ( ( pSetupReqPak->wValue ) >> 8 ) )
+                        {
+                            case USB_DESCR_TYP_DEVICE : // Device
+                                pDescr = MyDevDescr;
+                                len = MyDevDescr[0];
+                                break;
+                            case USB_DESCR_TYP_CONFIG : // Configuration
+                                pDescr = MyCfgDescr;
+                                len = MyCfgDescr[2] + (MyCfgDescr[3] << 8); // Total length
+                                break;
+                            case USB_DESCR_TYP_HID : // HID class descriptor, embedded in the configuration
+                                if ( ( ( pSetupReqPak->wIndex ) & 0xff ) == 0 )
+                                {
+                                    pDescr = MyCfgDescr + 18;
+                                    len = MyCfgDescr[18];
+                                }
+                                else errflag = 0xff;
+                                break;
+                            case USB_DESCR_TYP_REPORT : // HID Report
+                                if ( ( ( pSetupReqPak->wIndex ) & 0xff ) == 0 ) // Interface 0 report
+                                {
+                                    pDescr = MyHIDReportDescr;
+                                    len = sizeof( MyHIDReportDescr );
+                                }
+                                else errflag = 0xff;
+                                break;
+                            case USB_DESCR_TYP_STRING : // String
+                            {
+                                // Only one language is offered, so wIndex (LANGID) is not checked:
+                                // hosts ask with 0x0409 or 0 and expect the same strings.
+                                switch ( ( pSetupReqPak->wValue ) & 0xff )
+                                {
+                                    case 1 : pDescr = MyManuInfo; len = MyManuInfo[0]; break;
+                                    case 2 : pDescr = MyProdInfo; len = MyProdInfo[0]; break;
+                                    case 3 : pDescr = MySerialInfo; len = MySerialInfo[0]; break;
+                                    case 0 : pDescr = MyLangDescr; len = MyLangDescr[0]; break;
+                                    default : errflag = 0xFF; break;
+                                }
+                            }
+                            break;
+                            // Device qualifier / other speed: a full-speed only device
+                            // must answer with a request error (USB 2.0 9.6.2), hosts expect it
+                            case USB_DESCR_TYP_QUALIF :
+                            case USB_DESCR_TYP_SPEED :
+                            default :
+                                errflag = 0xff;
+                                break;
+                        }
+                    }
+                    break;
+                    case USB_SET_ADDRESS :
+                        SetupReqLen = ( pSetupReqPak->wValue ) & 0xff;
+                        break;
+                    case USB_SET_CONFIGURATION :
+                        if ( ( ( pSetupReqPak->wValue ) & 0xff ) > 1 )
+                        {
+                            errflag = 0xff;
+                            break;
+                        }
+                        DevConfig = ( pSetupReqPak->wValue ) & 0xff;
+                        R8_UEP1_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK | RB_UEP_AUTO_TOG; // Set EP1 for data transfer
+                        UsbState = DevConfig ? USB_STATE_CONFIGURED : USB_STATE_ADDRESSED;
+                        break;
+                    case USB_GET_CONFIGURATION :
+                        UsbReplyBuf[0] = DevConfig;
+                        len = 1;
+                        break;
+                    case USB_GET_INTERFACE :
+                        // One interface without alternate settings, valid once configured
+                        if ( UsbState != USB_STATE_CONFIGURED || ( pSetupReqPak->wIndex ) != 0 )
+                        {
+                            errflag = 0xff;
+                            break;
+                        }
+                        UsbReplyBuf[0] = 0;
+                        len = 1;
+                        break;
+                    case USB_SET_INTERFACE :
+                        if ( ( pSetupReqPak->wIndex ) != 0 || ( pSetupReqPak->wValue ) != 0 )
+                            errflag = 0xff;
+                        break;
+                    case USB_CLEAR_FEATURE :
+                    case USB_SET_FEATURE :
+                        if ( ( chtype & USB_REQ_RECIP_MASK ) == USB_REQ_RECIP_DEVICE
+                             && pSetupReqPak->wValue == USB_FEATURE_REMOTE_WAKEUP )
+                        {
+                            // Only allowed because bmAttributes advertises remote wakeup
+                            UsbRemoteWakeupEn = ( SetupReqCode == USB_SET_FEATURE );
+                        }
+                        else if ( ( chtype & USB_REQ_RECIP_MASK ) == USB_REQ_RECIP_ENDP
+                                  && pSetupReqPak->wValue == USB_FEATURE_ENDPOINT_HALT
+                                  && ( (pSetupReqPak->wIndex) & 0xff ) == 0x81 )
+                        {
+                            // Endpoint 1 halt set/clear (clear also resets the data toggle)
+                            if ( SetupReqCode == USB_SET_FEATURE )
+                                R8_UEP1_CTRL = ( R8_UEP1_CTRL & ~MASK_UEP_T_RES ) | UEP_T_RES_STALL;
+                            else
+                                R8_UEP1_CTRL = ( R8_UEP1_CTRL & ~( RB_UEP_T_TOG | MASK_UEP_T_RES ) ) | UEP_T_RES_NAK;
+                        }
+                        else
+                        {
+                            errflag = 0xff;
+                        }
+                        break;
+                    case USB_GET_STATUS :
+                        // Device: bit0 self powered (no), bit1 remote wakeup enabled
+                        // Endpoint: bit0 halted. Interface: always zero.
+                        UsbReplyBuf[0] = 0;
+                        UsbReplyBuf[1] = 0;
+                        if ( ( chtype & USB_REQ_RECIP_MASK ) == USB_REQ_RECIP_DEVICE )
+                            UsbReplyBuf[0] = UsbRemoteWakeupEn ? 0x02 : 0x00;
+                        else if ( ( chtype & USB_REQ_RECIP_MASK ) == USB_REQ_RECIP_ENDP
+                                  && ( (pSetupReqPak->wIndex) & 0xff ) == 0x81 )
+                            UsbReplyBuf[0] = ( ( R8_UEP1_CTRL & MASK_UEP_T_RES ) == UEP_T_RES_STALL ) ? 0x01 : 0x00;
+                        len = 2;
+                        break;
+                    default :
+                        // SET_DESCRIPTOR, SYNCH_FRAME: not supported
+                        errflag = 0xff;
+                        break;
+                }
+            } else if ( ( chtype & USB_REQ_TYP_MASK ) == USB_REQ_TYP_CLASS ) {
+                // HID Class requests (HID 1.11 section 7.2)
+                switch ( SetupReqCode )
+                {
+                    case HID_GET_REPORT :
+                    {
+                        // wValue low byte = report ID (0 without report IDs)
+                        const HidReport *r = &HidLastReport[( pSetupReqPak->wValue & 0xFF ) == HID_ID_CONSUMER ? HID_CH_CONSUMER : HID_CH_KEYBOARD];
+                        pDescr = r->data;
+                        len = r->len;
+                        break;
+                    }
+                    case HID_GET_IDLE :
+                        UsbReplyBuf[0] = UsbIdleRate;
+                        len = 1;
+                        break;
+                    case HID_GET_PROTOCOL :
+                        UsbReplyBuf[0] = UsbProtocol;
+                        len = 1;
+                        break;
+                    case HID_SET_IDLE :
+                        UsbIdleRate = ( pSetupReqPak->wValue ) >> 8;
+                        break;
+                    case HID_SET_PROTOCOL :
+                        UsbProtocol = ( pSetupReqPak->wValue ) & 0xff;
+                        break;
+                    case HID_SET_REPORT :
+                        break; // LED byte arrives in the OUT data stage
+                    default :
+                        errflag = 0xff;
+                        break;
+                }
+            } else if ( ( chtype & USB_REQ_TYP_MASK ) == USB_REQ_TYP_VENDOR ) {
+                len = USB_VendorSetup();
+                if ( len == USB_VENDOR_STALL ) errflag = 0xff;
+            } else {
+                errflag = 0xff;
+            }
+
+            if ( errflag == 0xff )
+            {
+                R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_STALL | UEP_T_RES_STALL; // STALL
+                UsbStallCount++;
+                USB_TraceAdd( USB_TRACE_STALL );
+            }
+            else
+            {
+                // Prepare for the data stage (send data if IN request)
+                if ( chtype & USB_REQ_TYP_IN )
+                {
+                    if ( SetupReqLen > len ) SetupReqLen = len; // Cap requested length
+                    len = ( SetupReqLen >= DevEP0SIZE ) ? DevEP0SIZE : SetupReqLen;
+                    memcpy( pEP0_RAM_Addr, pDescr, len );
+                    SetupReqLen -= len;
+                    pDescr += len;
+                }
+                else len = 0; // OUT request (Status stage)
+
+                R8_UEP0_T_LEN = len;
+                R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_ACK;
+                USB_TraceAdd( USB_TRACE_OK );
+            }
+
+            R8_USB_INT_FG = RB_UIF_TRANSFER;
+        }
+    }
+    // --- Bus Reset (Re-initialization) ---
+    else if ( intflag & RB_UIF_BUS_RST )
+    {
+        R8_USB_DEV_AD = 0;
+        DevConfig = 0;
+        UsbRemoteWakeupEn = 0;
+        UsbProtocol = 1;
+        UsbState = USB_STATE_DEFAULT;
+        UsbBusResetCount++;
+        USB_TraceAdd( USB_TRACE_RESET );
+        // Reset all endpoints to ACK/NAK
+        R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+        R8_UEP1_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK | RB_UEP_AUTO_TOG;
+        R8_USB_INT_FG = RB_UIF_BUS_RST;
+    }
+    // --- Suspend ---
+    else if ( intflag & RB_UIF_SUSPEND )
+    {
+        // The same flag fires on suspend and on resume; MIS_ST tells which
+        if ( R8_USB_MIS_ST & RB_UMS_SUSPEND )
+        {
+            if ( UsbState != USB_STATE_SUSPENDED )
+            {
+                UsbStateBeforeSuspend = UsbState;
+                Ep1CtrlBeforeSuspend = R8_UEP1_CTRL;
+                UsbState = USB_STATE_SUSPENDED;
+            }
+        }
+        else if ( UsbState == USB_STATE_SUSPENDED )
+        {
+            // Resume: restore EP1 exactly as it was (toggle, pending report)
+            R8_UEP1_CTRL = Ep1CtrlBeforeSuspend;
+            UsbState = UsbStateBeforeSuspend;
+        }
+        R8_USB_INT_FG = RB_UIF_SUSPEND;
+    }
+    else
+    {
+        R8_USB_INT_FG = intflag; // Clear any other flags
+    }
+}
+
+#endif
@@ -0,0 +1,134 @@
+"""
+False-trigger rate vs. threshold on a recorded touch trace.
+
+Record with the console command `trace 1` while nobody touches the pads
+(e.g. with the charger / LED PWM noise source running), save the UART log,
+then run:
+
+    python tools/false_trigger.py capture.log [--debounce N] [--min 20 --max 200 --step 10]
+
+Every "T,<scan>,<key>,<d0>,<d1>,..." line holds the per-hop deltas of one key in
+one sweep. Since the capture is untouched, any debounced press is a false
+trigger. The table compares hop 0 alone (the old single-frequency acquisition)
+with the median of all hops (what the firmware uses now).
+
+There is no capture from the board in the tree yet, so TOUCH_THRES (140) and
+TOUCH_HOP_STEP (3) in touch.h are not tuned from a recorded run. `--synth N`
+generates an untouched trace instead (white noise plus bursts locked to hop 0)
+for the key count in src/keyboard_def.h and TOUCH_HOPS in touch.h. That
+checks the tool and shows the effect of the median:
+
+    $ python tools/false_trigger.py --synth 20000 --max 140 --step 20
+    3 keys, 20000 sweeps, debounce 1
+    thres  single/1k sweeps  hopped/1k sweeps
+       20            107.65             40.90
+       40              9.60              0.25
+       60             11.60              0.00
+       80             76.15              0.00
+      100             64.70              0.00
+      120              2.05              0.00
+      140              0.00              0.00
+"""
+import argparse
+import os
+import random
+import re
+from collections import defaultdict
+
+SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")
+
+
+def load(path):
+    traces = defaultdict(list)  # key -> [[d0, d1, ...], ...] in sweep order
+    with open(path, errors="ignore") as f:
+        for line in f:
+            parts = line.strip().split(",")
+            if len(parts) < 4 or parts[0] != "T":
+                continue
+            try:
+                traces[int(parts[2])].append([int(v) for v in parts[3:]])
+            except ValueError:
+                continue
+    return traces
+
+
+def cdiv(a, b):
+    # C integer division truncates toward zero, Python's // floors
+    return int(a / b)
+
+
+def median(values):
+    # Touch_HopCombine(): middle value of three, mean of two (C division)
+    s = sorted(values)
+    n = len(s)
+    return s[n // 2] if n % 2 else cdiv(s[n // 2 - 1] + s[n // 2], 2)
+
+
+def presses(deltas, thres, debounce):
+    # Same rule as Touch_Debounce(): state flips after `debounce` consecutive disagreeing sweeps
+    pressed, count, n = False, 0, 0
+    for d in deltas:
+        active = d > thres
+        if active == pressed:
+            count = 0
+            continue
+        count += 1
+        if count >= debounce:
+            count = 0
+            pressed = active
+            n += active
+    return n
+
+
+def firmware_shape():
+    # Key count from the KEYBOARD_KEYS table and TOUCH_HOPS, so the synthetic
+    # panel is the one the firmware scans
+    with open(os.path.join(SRC, "keyboard_def.h")) as f:
+        table = re.search(r"#define KEYBOARD_KEYS\(KEY\)((?:.*\\\n)*.*)", f.read()).group(1)
+    with open(os.path.join(SRC, "touch.h")) as f:
+        hops = int(re.search(r"#define TOUCH_HOPS (\d+)", f.read()).group(1))
+    return len(re.findall(r"\bKEY\(", table)), hops
+
+
+def synth(sweeps, keys, hops, seed=1):
+    # Untouched panel: white noise on every hop plus bursts locked to hop 0's
+    # sampling frequency (what a charger or LED PWM near one frequency does)
+    rng = random.Random(seed)
+    traces = defaultdict(list)
+    for k in range(keys):
+        for n in range(sweeps):
+            burst = 90 if (n // 50) % 7 == 0 else 0
+            traces[k].append([int(rng.gauss(0, 12)) + (burst if h == 0 else 0) for h in range(hops)])
+    return traces
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("log", nargs="?")
+    ap.add_argument("--synth", type=int, metavar="SWEEPS", help="use a generated trace instead of a log")
+    ap.add_argument("--debounce", type=int, default=1)
+    ap.add_argument("--min", type=int, default=20)
+    ap.add_argument("--max", type=int, default=200)
+    ap.add_argument("--step", type=int, default=10)
+    args = ap.parse_args()
+
+    if args.synth:
+        traces = synth(args.synth, *firmware_shape())
+    elif args.log:
+        traces = load(args.log)
+    else:
+        ap.error("give a capture log or --synth SWEEPS")
+    if not traces:
+        raise SystemExit("no 'T,' lines found - was `trace 1` enabled?")
+
+    sweeps = max(len(t) for t in traces.values())
+    print(f"{len(traces)} keys, {sweeps} sweeps, debounce {args.debounce}")
+    print("thres  single/1k sweeps  hopped/1k sweeps")
+    for thres in range(args.min, args.max + 1, args.step):
+        single = sum(presses([s[0] for s in t], thres, args.debounce) for t in traces.values())
+        hopped = sum(presses([median(s) for s in t], thres, args.debounce) for t in traces.values())
+        print(f"{thres:5d}  {1000.0 * single / sweeps:16.2f}  {1000.0 * hopped / sweeps:16.2f}")
+
+
+if __name__ == "__main__":
+    main()